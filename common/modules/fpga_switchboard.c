@@ -0,0 +1,5082 @@
+/*
+ * fpga_switchboard.c - driver for Celestica Switch board FPGA/CPLD.
+ *
+ * Author: Pradchaya Phucharoen
+ *
+ * Copyright (C) 2018 Celestica Corp.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Shared by the silverstone and questone2 switchboard modules, each board
+ * supplies its bus topology through fpga_switchboard_init().
+ *
+ *   /
+ *   \--sys
+ *       \--devices
+ *            \--platform
+ *                \--<driver_name>
+ *                    |--FPGA
+ *                    |--CPLD1
+ *                    |--CPLD2
+ *                    \--SFF
+ *                        |--QSFP[1..n]
+ *                        \--SFP[1..n]
+ *
+ */
+
+#include <linux/interrupt.h>
+#include <linux/module.h>
+#include <linux/pci.h>
+#include <linux/kernel.h>
+#include <linux/stddef.h>
+#include <linux/delay.h>
+#include <linux/ioport.h>
+#include <linux/init.h>
+#include <linux/i2c.h>
+#include <linux/acpi.h>
+#include <linux/io.h>
+#include <linux/dmi.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+#include <linux/err.h>
+#include <linux/kobject.h>
+#include <linux/platform_device.h>
+#include <linux/types.h>
+#include <uapi/linux/stat.h>
+#include <linux/fs.h>
+#include <linux/uaccess.h>
+#include <linux/jiffies.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/regmap.h>
+#include <linux/async.h>
+#include <linux/cdev.h>
+#include <linux/idr.h>
+#include <linux/firmware.h>
+#include <linux/hwmon.h>
+#include <linux/hwmon-sysfs.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/vmalloc.h>
+
+#include "fpga_switchboard.h"
+
+#define CREATE_TRACE_POINTS
+#include "fpga_switchboard_trace.h"
+
+
+#define DEVICE_NAME "fwupgrade"
+
+/*
+ * The FPGA_INT_* bit layout below is not confirmed against the FPGA register
+ * spec, so the interrupt path stays off unless asked for. Polling is the
+ * supported default: I2C transfers spin on the master status register as
+ * they always did, and no interrupt driven port events are batched.
+ */
+static bool use_irq;
+module_param(use_irq, bool, 0444);
+MODULE_PARM_DESC(use_irq, "Take the FPGA interrupt for I2C and port events (default off, polling)");
+
+/* The PSU PMBus addresses are not confirmed, see psu_pmbus_addr */
+static bool psu_telemetry;
+module_param(psu_telemetry, bool, 0444);
+MODULE_PARM_DESC(psu_telemetry, "Sample PSU PMBus telemetry on the PSU bus (default off)");
+
+/* The fan CPLD presence register is not confirmed, see FAN_CPLD_ADDR */
+static bool fan_fru;
+module_param(fan_fru, bool, 0444);
+MODULE_PARM_DESC(fan_fru, "Follow fan tray presence and cache the fan FRU EEPROMs (default off)");
+
+
+static int smbus_access(struct i2c_adapter *adapter, u16 addr,
+                        unsigned short flags, char rw, u8 cmd,
+                        int size, union i2c_smbus_data *data);
+
+static int fpga_i2c_access(struct i2c_adapter *adapter, u16 addr,
+                           unsigned short flags, char rw, u8 cmd,
+                           int size, union i2c_smbus_data *data);
+
+static int fpga_i2c_xfer(struct i2c_adapter *adapter, u16 addr,
+                         unsigned short flags, char rw, u8 cmd,
+                         int size, union i2c_smbus_data *data);
+
+struct fpga_device;
+static int fpgafw_init(struct fpga_device *fpga_dev);
+static void fpgafw_exit(struct fpga_device *fpga_dev);
+
+struct switchboard_fpga_data;
+static void switch_cpld_cache_sync(struct switchboard_fpga_data *fpga_data);
+
+
+/*
+========================================
+FPGA PCIe BAR 0 Registers
+========================================
+Misc Control    0x00000000 – 0x000000FF.
+I2C_CH1         0x00000100 - 0x00000110
+I2C_CH2         0x00000200 - 0x00000210.
+I2C_CH3         0x00000300 - 0x00000310.
+I2C_CH4         0x00000400 - 0x00000410.
+I2C_CH5         0x00000500 - 0x00000510.
+I2C_CH6         0x00000600 - 0x00000610.
+I2C_CH7         0x00000700 - 0x00000710.
+I2C_CH8         0x00000800 - 0x00000810.
+I2C_CH9         0x00000900 - 0x00000910.
+I2C_CH10        0x00000A00 - 0x00000A10.
+I2C_CH11        0x00000B00 - 0x00000B10.
+I2C_CH12        0x00000C00 - 0x00000C10.
+I2C_CH13        0x00000D00 - 0x00000D10.
+SPI Master      0x00001200 - 0x00001300.
+DPLL SPI Master 0x00001320 - 0x0000132F.
+PORT XCVR       0x00004000 - 0x00004FFF.
+*/
+
+/* MISC       */
+#define FPGA_VERSION            0x0000
+#define FPGA_VERSION_MJ_MSK     0xff00
+#define FPGA_VERSION_MN_MSK     0x00ff
+#define FPGA_SCRATCH            0x0004
+#define FPGA_BROAD_TYPE         0x0008
+#define FPGA_BROAD_REV_MSK      0x0038
+#define FPGA_BROAD_ID_MSK       0x0007
+#define FPGA_PLL_STATUS         0x0014
+#define BMC_I2C_SCRATCH         0x0020
+#define FPGA_SLAVE_CPLD_REST    0x0030
+#define FPGA_PERIPH_RESET_CTRL  0x0034
+#define FPGA_INT_STATUS         0x0040
+#define FPGA_INT_SRC_STATUS     0x0044
+#define FPGA_INT_FLAG           0x0048
+#define FPGA_INT_MASK           0x004c
+#define FPGA_MISC_CTRL          0x0050
+#define FPGA_MISC_STATUS        0x0054
+#define FPGA_AVS_VID_STATUS     0x0068
+#define FPGA_PORT_XCVR_READY    0x000c
+
+/* I2C_MASTER BASE ADDR */
+#define I2C_MASTER_FREQ_1           0x0100
+#define I2C_MASTER_CTRL_1           0x0104
+#define I2C_MASTER_STATUS_1         0x0108
+#define I2C_MASTER_DATA_1           0x010c
+#define I2C_MASTER_PORT_ID_1        0x0110
+
+/* SPI_MASTER */
+#define SPI_MASTER_WR_EN            0x1200 /* one bit */
+#define SPI_MASTER_WR_DATA          0x1204 /* 32 bits */
+#define SPI_MASTER_CHK_ID           0x1208 /* one bit */
+#define SPI_MASTER_VERIFY           0x120c /* one bit */
+#define SPI_MASTER_STATUS           0x1210 /* 15 bits */
+#define SPI_MASTER_MODULE_RST       0x1214 /* one bit */
+
+/* FPGA FRONT PANEL PORT MGMT */
+#define SFF_PORT_CTRL_BASE          0x4000
+#define SFF_PORT_STATUS_BASE        0x4004
+#define SFF_PORT_INT_STATUS_BASE    0x4008
+#define SFF_PORT_INT_MASK_BASE      0x400c
+
+#define PORT_XCVR_REGISTER_SIZE     0x1000
+
+/* PORT CTRL REGISTER
+[31:7]  RSVD
+[6]     LPMOD   6
+[5]     RSVD
+[4]     RST     4
+[3:1]   RSVD
+[0]     TXDIS   0
+*/
+#define CTRL_LPMOD   6
+#define CTRL_RST     4
+#define CTRL_TXDIS   0
+
+/* Longest control pulse accepted by the bulk port control attributes */
+#define SFF_PORT_PULSE_MAX_US   10000000
+
+/* PORT STATUS REGISTER
+[31:6]  RSVD
+[5]     IRQ         5
+[4]     PRESENT     4
+[3]     RSVD
+[2]     TXFAULT     2
+[1]     RXLOS       1
+[0]     MODABS      0
+*/
+#define STAT_IRQ         5
+#define STAT_PRESENT     4
+#define STAT_TXFAULT     2
+#define STAT_RXLOS       1
+#define STAT_MODABS      0
+#define STAT_MSK         0x37
+
+/* Status transitions kept per port, and the sampling period used without an interrupt */
+#define PORT_HISTORY_LEN            32
+#define PORT_HISTORY_SAMPLE_MS      10
+#define PORT_HISTORY_SAMPLE_MAX_MS  10000
+
+/*
+ * Transceiver management interface readiness. After reset release or
+ * insertion a QSFP answers within t_init and clears Data_Not_Ready once its
+ * memory map is valid, a SFP only needs its start up time.
+ */
+#define PORT_READY_QSFP_INIT_MS     2000
+#define PORT_READY_SFP_INIT_MS      300
+#define PORT_READY_POLL_MS          100
+#define PORT_READY_WAIT_MAX_MS      10000
+#define SFF_EEPROM_ADDR             0x50
+#define SFF8636_STATUS              2
+#define SFF8636_DATA_NOT_READY      0x01
+
+/* PMBus telemetry of the PSUs on the PSU bus */
+#define PSU_MAX                     2
+#define PSU_SAMPLE_MS               1000
+#define PSU_SAMPLE_MIN_MS           100
+#define PSU_SAMPLE_MAX_MS           60000
+#define PMBUS_READ_VIN              0x88
+#define PMBUS_READ_IOUT             0x8C
+#define PMBUS_READ_TEMPERATURE_1    0x8D
+#define PMBUS_READ_POUT             0x96
+
+enum psu_sensor {
+    PSU_VIN,
+    PSU_IOUT,
+    PSU_POUT,
+    PSU_TEMP,
+    PSU_SENSOR_MAX
+};
+
+/*
+ * PMBus address of PSU1 and PSU2. These are assumptions, not taken from a
+ * board spec; confirm them on hardware before enabling psu_telemetry.
+ */
+static const u16 psu_pmbus_addr[PSU_MAX] = { 0x58, 0x59 };
+
+/* Register and hwmon unit of each sensor, all LINEAR11 */
+static const struct {
+    u8 reg;
+    s64 scale;
+} psu_sensors[PSU_SENSOR_MAX] = {
+    [PSU_VIN]  = { PMBUS_READ_VIN, 1000 },              // mV
+    [PSU_IOUT] = { PMBUS_READ_IOUT, 1000 },             // mA
+    [PSU_POUT] = { PMBUS_READ_POUT, 1000000 },          // uW
+    [PSU_TEMP] = { PMBUS_READ_TEMPERATURE_1, 1000 },    // millidegree C
+};
+
+struct psu_telemetry {
+    struct switchboard_fpga_data *fpga_data;
+    struct device *hwmon;
+    u16 raw[PSU_SENSOR_MAX];        // Last sample of each sensor
+    int err[PSU_SENSOR_MAX];        // Error of the last sample, 0 if valid
+    unsigned long updated;          // Jiffies of the last sample, 0 before the first
+};
+
+/* SI5344 clock generator, 16 bit registers behind a page register */
+#define SI5344_ADDR                 0x68
+#define SI5344_PAGE                 0x01
+#define SI5344_STATUS               0x000C
+#define SI5344_STATUS_MSK           0x0B    /* LOL, LOSXAXB, SYSINCAL */
+#define SI5344_PREAMBLE_REG         0x0540
+#define SI5344_PREAMBLE_VAL         0x01
+#define SI5344_PREAMBLE_DELAY_MS    300
+#define SI5344_LOCK_TIMEOUT_MS      2000
+
+/*
+ * UCD90120 rail sampler. All rails are read at a fixed rate into a ring
+ * that freezes a pre/post-trigger window when a rail drops below its
+ * threshold.
+ */
+#define UCD90120_ADDR               0x34
+#define UCD90120_RAILS              12
+#define PMBUS_PAGE                  0x00
+#define PMBUS_VOUT_MODE             0x20
+#define PMBUS_READ_VOUT             0x8B
+#define UCD_CAPTURE_LEN             512
+#define UCD_SAMPLE_US               5000
+#define UCD_SAMPLE_MIN_US           1000
+#define UCD_SAMPLE_MAX_US           1000000
+
+/* One sample, the record format of the capture attribute */
+struct ucd_sample {
+    s64 ts;                         // CLOCK_MONOTONIC time in ns, 0 if unused
+    u16 rail_mv[UCD90120_RAILS];
+    u16 flags;
+    u16 reserved;
+};
+#define UCD_SAMPLE_TRIGGER          0x0001  /* The sample that triggered the capture */
+#define UCD_CAPTURE_SIZE            (UCD_CAPTURE_LEN * sizeof(struct ucd_sample))
+
+enum ucd_state {
+    UCD_ARMED,
+    UCD_TRIGGERED,
+    UCD_FROZEN,
+};
+
+/*
+ * Board sensor hub. Channels on different masters are read concurrently
+ * and published together as one snapshot.
+ */
+#define HUB_CHANNEL_MAX             32
+#define HUB_INTERVAL_MS             1000
+#define HUB_INTERVAL_MIN_MS         50
+#define HUB_INTERVAL_MAX_MS         60000
+
+enum hub_size {
+    HUB_BYTE,
+    HUB_WORD,
+    HUB_WORD_SWAPPED,               // Word with the MSB first, like LM75
+};
+
+struct hub_channel {
+    u16 bus;                        // Bus index in the topology
+    u8 addr;
+    u8 reg;
+    enum hub_size size;
+};
+
+/* One reading of the snapshot */
+struct hub_reading {
+    u16 bus;
+    u8 addr;
+    u8 reg;
+    s32 value;                      // Register value, or a negative error code
+};
+
+/* The record format of the snapshot attribute */
+struct hub_snapshot {
+    s64 ts;                         // CLOCK_MONOTONIC time of the refresh in ns
+    u32 seq;                        // Refresh count
+    u32 count;                      // Valid readings
+    struct hub_reading reading[HUB_CHANNEL_MAX];
+};
+
+struct hub_master {
+    struct work_struct work;
+    struct switchboard_fpga_data *fpga_data;
+    unsigned char master_bus;
+};
+
+/*
+ * Fan tray FRU EEPROMs behind the fan master mux. The fan CPLD on the same
+ * master reports which trays are present.
+ *
+ * The fan CPLD address, its presence register and the presence bit layout
+ * are assumptions, not taken from a CPLD spec. Confirm them on hardware
+ * before enabling the fan_fru module parameter.
+ */
+#define FAN_TRAY_MAX                8
+#define FAN_FRU_ADDR                0x50
+#define FAN_FRU_SIZE                256
+#define FAN_CPLD_ADDR               0x0d
+#define FAN_CPLD_PRESENCE           0x26
+#define FAN_PRESENCE_POLL_MS        1000
+
+struct fan_fru {
+    int bus;                        // Bus index of the tray EEPROM
+    bool present;
+    bool valid;                     // data holds the FRU of the present tray
+    u8 *data;
+    struct bin_attribute attr;
+};
+
+enum port_ready_state {
+    PORT_READY = 0,
+    PORT_IN_RESET,
+    PORT_INITIALIZING,
+};
+
+struct port_ready {
+    enum port_ready_state state;
+    unsigned long deadline;         // Jiffies when the port counts as ready anyway
+    unsigned long next_poll;        // Jiffies of the next Data_Not_Ready check
+};
+
+static void port_ready_update(struct switchboard_fpga_data *fpga_data, uint64_t ports,
+                              enum port_ready_state state);
+
+/* PORT INTRPT REGISTER
+[31:6]  RSVD
+[5]     INT_N       5
+[4]     PRESENT     4
+[3]     RSVD
+[2]     RSVD
+[1]     RXLOS       1
+[0]     MODABS      0
+*/
+#define INTR_INT_N      5
+#define INTR_PRESENT    4
+#define INTR_TXFAULT    2
+#define INTR_RXLOS      1
+#define INTR_MODABS     0
+
+/* PORT INT MASK REGISTER
+[31:6]  RSVD
+[5]     INT_N       5
+[4]     PRESENT     4
+[3]     RSVD
+[2]     RSVD
+[1]     RXLOS_INT   1
+[0]     MODABS      0
+*/
+#define MASK_INT_N      5
+#define MASK_PRESENT    4
+#define MASK_TXFAULT    2
+#define MASK_RXLOS      1
+#define MASK_MODABS     0
+
+/* FPGA INTERRUPT REGISTERS
+Assumed layout, not confirmed against the FPGA register spec. Only used with
+the use_irq module parameter.
+FPGA_INT_STATUS, FPGA_INT_FLAG and FPGA_INT_MASK share one layout.
+Writing 1 to a FPGA_INT_FLAG bit clears it, a 1 in FPGA_INT_MASK masks it.
+[31:17] RSVD
+[16]    PORT        16  port event pending, see FPGA_INT_SRC_STATUS
+[15:13] RSVD
+[12:0]  I2C_CH          transfer done, bit 0 is I2C_MASTER_CH_1
+
+FPGA_INT_SRC_STATUS
+[31:8]  RSVD
+[7:0]   PORT_GROUP      group n has a port interrupt, ports 8n+1 to 8n+8
+Port interrupt register bits are cleared by writing 1.
+*/
+#define INT_PORT                16
+#define INT_I2C_MSK             0x1fff
+#define INT_PORT_GROUP_SIZE     8
+
+/* Port events closer together than this are notified as one batch */
+#define PORT_EVENT_COALESCE_MS      20
+#define PORT_EVENT_COALESCE_MAX_MS  10000
+
+enum {
+    I2C_SR_BIT_RXAK = 0,
+    I2C_SR_BIT_MIF,
+    I2C_SR_BIT_SRW,
+    I2C_SR_BIT_BCSTM,
+    I2C_SR_BIT_MAL,
+    I2C_SR_BIT_MBB,
+    I2C_SR_BIT_MAAS,
+    I2C_SR_BIT_MCF
+};
+
+enum {
+    I2C_CR_BIT_BCST = 0,
+    I2C_CR_BIT_RSTA = 2,
+    I2C_CR_BIT_TXAK,
+    I2C_CR_BIT_MTX,
+    I2C_CR_BIT_MSTA,
+    I2C_CR_BIT_MIEN,
+    I2C_CR_BIT_MEN,
+};
+
+/**
+ *
+ * The function is i2c algorithm implement to allow master access to
+ * correct endpoint devices trough the PCA9548 switch devices.
+ *
+ *  FPGA I2C Master [mutex resource]
+ *              |
+ *              |
+ *    ---------------------------
+ *    |        PCA9548(s)       |
+ *    ---1--2--3--4--5--6--7--8--
+ *       |  |  |  |  |  |  |  |
+ *   EEPROM      ...          EEPROM
+ *
+ */
+
+#define CPLD1_SLAVE_ADDR        0x30
+#define CPLD2_SLAVE_ADDR        0x31
+
+/* SWITCH CPLD REGISTERS */
+#define CPLD_VERSION            0x00
+#define CPLD_SCRATCH            0x01
+#define CPLD_LED_MODE           0x09
+#define CPLD_LED_COLOR          0x0A
+
+#define PCI_VENDOR_ID_TEST 0x1af4
+
+#ifndef PCI_VENDOR_ID_XILINX
+#define PCI_VENDOR_ID_XILINX 0x10EE
+#endif
+
+#define FPGA_PCIE_DEVICE_ID 0x7021
+#define TEST_PCIE_DEVICE_ID 0x1110
+
+
+#ifdef DEBUG_KERN
+#define info(fmt,args...)  printk(KERN_INFO "line %3d : "fmt,__LINE__,##args)
+#define check(REG)         printk(KERN_INFO "line %3d : %-8s = %2.2X",__LINE__,#REG,ioread8(REG));
+#else
+#define info(fmt,args...)
+#define check(REG)
+#endif
+
+#define GET_REG_BIT(REG,BIT)   ((ioread8(REG) >> BIT) & 0x01)
+#define SET_REG_BIT_H(REG,BIT) iowrite8(ioread8(REG) |  (0x01 << BIT),REG)
+#define SET_REG_BIT_L(REG,BIT) iowrite8(ioread8(REG) & ~(0x01 << BIT),REG)
+
+/*
+ * I2C traffic classes. When a master is released it is handed to the oldest
+ * waiter of the most urgent class, so short health reads overtake bulk
+ * transceiver EEPROM reads between transactions. A class that was passed
+ * over I2C_ARB_MAX_PASSED times in a row goes next, so a steady flow of
+ * urgent traffic cannot starve bulk readers.
+ */
+enum i2c_prio {
+    I2C_PRIO_HIGH,
+    I2C_PRIO_NORMAL,
+    I2C_PRIO_BULK,
+    I2C_PRIO_MAX
+};
+
+static const char *const i2c_prio_names[I2C_PRIO_MAX] = {
+    "high", "normal", "bulk",
+};
+
+#define I2C_ARB_MAX_PASSED      8
+
+/* A task queued for an I2C master, on its stack */
+struct i2c_master_waiter {
+    struct list_head list;
+    struct task_struct *task;
+    bool granted;                   // The master was handed to this task
+};
+
+struct i2c_dev_data {
+    int portid;
+    struct i2c_switch pca9548;
+    struct switchboard_fpga_data *fpga_data;
+    enum i2c_prio prio;             // Traffic class of this virtual bus
+};
+
+/*
+ * One switch FPGA on PCIe. Instance 0 keeps the historical device names
+ * and I2C bus numbers, later instances get suffixed names and dynamic
+ * I2C bus numbers.
+ */
+struct fpga_device {
+    /* data mmio region */
+    void __iomem *data_base_addr;
+    resource_size_t data_mmio_start;
+    resource_size_t data_mmio_len;
+    struct mutex fpga_lock;         // For FPGA internal lock
+    int instance;
+    const struct fpga_switchboard_topology *topo;
+    struct pci_dev *pci_dev;
+    int irq;                        // Vector allocated on the PCI function, 0 if none
+    const char *irq_type;
+    struct platform_device *pdev;   // Switchboard platform device of this FPGA
+    struct mutex switchboard_lock;  // For the switchboard pointer
+    struct switchboard_fpga_data *switchboard;  // Set while the switchboard is bound
+    /* FPGA firmware upgrade device node */
+    dev_t devt;
+    struct cdev cdev;
+    char class_name[32];
+    struct class *fpgafwclass;
+    struct device *fpgafwdev;
+};
+
+/* I2C master state, kept on its own cache line */
+struct fpga_i2c_master {
+    spinlock_t lock;                // For the arbitration state
+    bool busy;
+    struct list_head queue[I2C_PRIO_MAX];   // FIFO of waiters per traffic class
+    unsigned int passed[I2C_PRIO_MAX];      // Handoffs that skipped a waiting class
+    /* Store lasted switch address and channel */
+    uint16_t lasted_access_port;
+    unsigned char master_bus;
+    wait_queue_head_t wait;         // Woken by the transfer done interrupt
+    struct switchboard_fpga_data *fpga_data;
+} ____cacheline_aligned_in_smp;
+
+struct switch_cpld {
+    uint16_t slave_addr;
+    struct regmap *regmap;
+    struct switchboard_fpga_data *fpga_data;
+};
+
+struct switchboard_fpga_data {
+    struct fpga_device *fpga_dev;
+    const struct fpga_switchboard_topology *topo;
+    struct fpga_i2c_master i2c_master[FPGA_I2C_MASTER_MAX];
+    /*
+     * Kernel object for other module drivers.
+     * Other module can use these kobject as a parent.
+     */
+    struct kobject *fpga;
+    struct kobject *cpld1;
+    struct kobject *cpld2;
+    /* Device node in sysfs tree. */
+    struct device *sff_dev;
+    struct device *sff_devices[SFF_PORT_MAX];
+    struct i2c_client *sff_i2c_clients[SFF_PORT_MAX];
+    struct i2c_adapter *i2c_adapter[FPGA_I2C_BUS_MAX];
+    spinlock_t port_ctrl_lock;      // For port control register read-modify-write
+    struct hrtimer port_pulse_timer;
+    uint64_t port_pulse_mask;       // Ports waiting for the end of a control pulse
+    unsigned int port_pulse_bit;
+    int port_pulse_value;
+    int irq;                        // FPGA interrupt in use, 0 when polling
+    spinlock_t irq_lock;            // For FPGA_INT_MASK read-modify-write
+    atomic_long_t irq_i2c_count;
+    unsigned long irq_port_count;
+    spinlock_t event_lock;          // For the port event batch
+    uint64_t event_pending;         // Ports with events not notified yet
+    uint64_t event_last;            // Ports of the last notified batch
+    unsigned long event_batches;
+    unsigned int event_coalesce_ms;
+    struct delayed_work event_work;
+    ktime_t irq_ts;                 // Time of the last port interrupt
+    spinlock_t history_lock;        // For the port history rings
+    struct port_history *history;   // One ring per SFF port
+    unsigned int history_sample_ms;
+    struct delayed_work history_work;
+    spinlock_t ready_lock;          // For port_ready
+    struct port_ready port_ready[SFF_PORT_MAX];
+    wait_queue_head_t ready_wait;   // Woken when a port becomes ready
+    unsigned int ready_wait_ms;     // How long an access waits for readiness, 0 fails at once
+    struct delayed_work ready_work;
+    int psu_bus;                    // Index of the PSU bus, negative if none
+    spinlock_t psu_lock;            // For the PSU telemetry cache
+    struct psu_telemetry psu[PSU_MAX];
+    unsigned int psu_sample_ms;
+    struct delayed_work psu_work;
+    int si5344_bus;                 // Index of the SI5344 bus, negative if none
+    struct mutex si5344_lock;       // For register map loads
+    int si5344_page;                // Current page, -1 if unknown
+    int si5344_result;              // Result of the last load
+    u32 si5344_regs;
+    u32 si5344_xfers;
+    s64 si5344_load_us;
+    u8 si5344_status;
+    int ucd_bus;                    // Index of the UCD90120 bus, negative if none
+    struct task_struct *ucd_thread;
+    wait_queue_head_t ucd_wait;     // Woken when sampling may resume
+    spinlock_t ucd_lock;            // For the ring and the trigger state
+    struct ucd_sample *ucd_ring;
+    unsigned int ucd_head;          // Next slot to write
+    enum ucd_state ucd_state;
+    unsigned int ucd_post_trigger;  // Samples kept after the trigger
+    unsigned int ucd_post_left;
+    int ucd_trigger_rail;
+    ktime_t ucd_trigger_ts;
+    u16 ucd_threshold_mv[UCD90120_RAILS];
+    unsigned int ucd_sample_us;
+    int ucd_exp[UCD90120_RAILS];    // VOUT_MODE exponent of each rail
+    bool ucd_exp_valid;
+    unsigned long ucd_samples;
+    unsigned long ucd_errors;
+    bool hub_active;
+    struct mutex hub_lock;          // For the hub channels and refresh
+    struct hub_channel hub_channels[HUB_CHANNEL_MAX];
+    int hub_n_channels;
+    struct hub_reading hub_stage[HUB_CHANNEL_MAX];  // Readings of the refresh in progress
+    struct hub_master hub_master[FPGA_I2C_MASTER_MAX];
+    spinlock_t hub_snap_lock;       // For hub_snap
+    struct hub_snapshot hub_snap;
+    unsigned int hub_interval_ms;
+    struct delayed_work hub_work;
+    int fan_cpld_bus;               // Index of the fan CPLD bus, negative if none
+    int n_fans;                     // Fan trays with a cached FRU
+    struct mutex fan_fru_lock;      // For fan_fru present and valid, and the cache
+    struct fan_fru fan_fru[FAN_TRAY_MAX];
+    struct bin_attribute *fan_fru_bin_attrs[FAN_TRAY_MAX + 1];
+    struct attribute_group fan_fru_grp;
+    struct delayed_work fan_fru_work;
+    void __iomem * fpga_read_addr;
+    uint8_t cpld1_read_addr;
+    uint8_t cpld2_read_addr;
+    struct switch_cpld cpld[2];     // CPLD1 and CPLD2 behind regmap
+    ktime_t probe_start;            // Probe timing breakdown, in us
+    ktime_t probe_async_start;
+    s64 probe_adapter_us;
+    s64 probe_sff_us;
+    s64 probe_mux_us;
+    s64 probe_client_us;
+    s64 probe_cpld_us;
+};
+
+/* One port status transition, the record format of the event_history attribute */
+struct port_history_entry {
+    s64 ts;                 // CLOCK_MONOTONIC time in ns
+    u32 seq;                // Per-port transition count, gaps mean overwritten entries
+    u16 status;             // Port status register after the transition
+    u16 changed;            // Status bits that changed
+};
+
+struct port_history {
+    struct port_history_entry entry[PORT_HISTORY_LEN];
+    unsigned int head;      // Next slot to write
+    u32 seq;
+    u16 status;             // Last seen port status
+};
+
+struct sff_device_data {
+    int portid;
+    enum PORT_TYPE port_type;
+    struct switchboard_fpga_data *fpga_data;
+};
+
+/**
+ * Find the switchboard data from one of the FPGA, CPLD1 and CPLD2
+ * kobjects, which are direct children of the platform device.
+ */
+static struct switchboard_fpga_data *kobj_to_fpga_data(struct kobject *kobj)
+{
+    return dev_get_drvdata(kobj_to_dev(kobj->parent));
+}
+
+/**
+ * Show the value of the register set by 'set_fpga_reg_address'
+ * If the address is not set by 'set_fpga_reg_address' first,
+ * The version register is selected by default.
+ * @param  buf     register value in hextring
+ * @return         number of bytes read, or an error code
+ */
+static ssize_t get_fpga_reg_value(struct device *dev, struct device_attribute *devattr,
+                                  char *buf)
+{
+    struct switchboard_fpga_data *fpga_data = kobj_to_fpga_data(&dev->kobj);
+    // read data from the address
+    uint32_t data;
+    data = ioread32(fpga_data->fpga_read_addr);
+    return sprintf(buf, "0x%8.8x\n", data);
+}
+/**
+ * Store the register address
+ * @param  buf     address wanted to be read value of
+ * @return         number of bytes stored, or an error code
+ */
+static ssize_t set_fpga_reg_address(struct device *dev, struct device_attribute *devattr,
+                                    const char *buf, size_t count)
+{
+    struct switchboard_fpga_data *fpga_data = kobj_to_fpga_data(&dev->kobj);
+    uint32_t addr;
+    char *last;
+
+    addr = (uint32_t)strtoul(buf, &last, 16);
+    if (addr == 0 && buf == last) {
+        return -EINVAL;
+    }
+    fpga_data->fpga_read_addr = fpga_data->fpga_dev->data_base_addr + addr;
+    return count;
+}
+/**
+ * Show value of fpga scratch register
+ * @param  buf     register value in hexstring
+ * @return         number of bytes read, or an error code
+ */
+static ssize_t get_fpga_scratch(struct device *dev, struct device_attribute *devattr,
+                                char *buf)
+{
+    struct switchboard_fpga_data *fpga_data = kobj_to_fpga_data(&dev->kobj);
+    return sprintf(buf, "0x%8.8x\n", ioread32(fpga_data->fpga_dev->data_base_addr + FPGA_SCRATCH) & 0xffffffff);
+}
+/**
+ * Store value of fpga scratch register
+ * @param  buf     scratch register value passing from user space
+ * @return         number of bytes stored, or an error code
+ */
+static ssize_t set_fpga_scratch(struct device *dev, struct device_attribute *devattr,
+                                const char *buf, size_t count)
+{
+    struct switchboard_fpga_data *fpga_data = kobj_to_fpga_data(&dev->kobj);
+    uint32_t data;
+    char *last;
+    data = (uint32_t)strtoul(buf, &last, 16);
+    if (data == 0 && buf == last) {
+        return -EINVAL;
+    }
+    iowrite32(data, fpga_data->fpga_dev->data_base_addr + FPGA_SCRATCH);
+    return count;
+}
+/**
+ * Store a value in a specific register address
+ * @param  buf     the value and address in format '0xhhhh 0xhhhhhhhh'
+ * @return         number of bytes sent by user space, or an error code
+ */
+static ssize_t set_fpga_reg_value(struct device *dev, struct device_attribute *devattr,
+                                  const char *buf, size_t count)
+{
+    struct switchboard_fpga_data *fpga_data = kobj_to_fpga_data(&dev->kobj);
+    // register are 4 bytes
+    uint32_t addr;
+    uint32_t value;
+    uint32_t mode = 8;
+    char *tok;
+    char clone[count];
+    char *pclone = clone;
+    char *last;
+
+    strcpy(clone, buf);
+
+    mutex_lock(&fpga_data->fpga_dev->fpga_lock);
+    tok = strsep((char**)&pclone, " ");
+    if (tok == NULL) {
+        mutex_unlock(&fpga_data->fpga_dev->fpga_lock);
+        return -EINVAL;
+    }
+    addr = (uint32_t)strtoul(tok, &last, 16);
+    if (addr == 0 && tok == last) {
+        mutex_unlock(&fpga_data->fpga_dev->fpga_lock);
+        return -EINVAL;
+    }
+    tok = strsep((char**)&pclone, " ");
+    if (tok == NULL) {
+        mutex_unlock(&fpga_data->fpga_dev->fpga_lock);
+        return -EINVAL;
+    }
+    value = (uint32_t)strtoul(tok, &last, 16);
+    if (value == 0 && tok == last) {
+        mutex_unlock(&fpga_data->fpga_dev->fpga_lock);
+        return -EINVAL;
+    }
+    tok = strsep((char**)&pclone, " ");
+    if (tok == NULL) {
+        mode = 32;
+    } else {
+        mode = (uint32_t)strtoul(tok, &last, 10);
+        if (mode == 0 && tok == last) {
+            mutex_unlock(&fpga_data->fpga_dev->fpga_lock);
+            return -EINVAL;
+        }
+    }
+    if (mode == 32) {
+        iowrite32(value, fpga_data->fpga_dev->data_base_addr + addr);
+    } else if (mode == 8) {
+        iowrite8(value, fpga_data->fpga_dev->data_base_addr + addr);
+    } else {
+        mutex_unlock(&fpga_data->fpga_dev->fpga_lock);
+        return -EINVAL;
+    }
+    mutex_unlock(&fpga_data->fpga_dev->fpga_lock);
+    if (addr == FPGA_SLAVE_CPLD_REST)
+        switch_cpld_cache_sync(fpga_data);
+    return count;
+}
+
+/**
+ * Read all FPGA XCVR register in binary mode.
+ * @param  buf   Raw transceivers port startus and control register values
+ * @return       number of bytes read, or an error code
+ */
+static ssize_t dump_read(struct file *filp, struct kobject *kobj,
+                         struct bin_attribute *attr, char *buf,
+                         loff_t off, size_t count)
+{
+    struct switchboard_fpga_data *fpga_data = kobj_to_fpga_data(kobj);
+    unsigned long i = 0;
+    ssize_t status;
+    u8 read_reg;
+
+    if ( off + count > PORT_XCVR_REGISTER_SIZE ) {
+        return -EINVAL;
+    }
+    mutex_lock(&fpga_data->fpga_dev->fpga_lock);
+    while (i < count) {
+        read_reg = ioread8(fpga_data->fpga_dev->data_base_addr + SFF_PORT_CTRL_BASE + off + i);
+        buf[i++] = read_reg;
+    }
+    status = count;
+    mutex_unlock(&fpga_data->fpga_dev->fpga_lock);
+    return status;
+}
+
+/**
+ * Show FPGA port XCVR ready status
+ * @param  buf  1 if the functin is ready, 0 if not.
+ * @return      number of bytes read, or an error code
+ */
+static ssize_t ready_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct switchboard_fpga_data *fpga_data = kobj_to_fpga_data(&dev->kobj);
+    u32 data;
+    unsigned int REGISTER = FPGA_PORT_XCVR_READY;
+
+    mutex_lock(&fpga_data->fpga_dev->fpga_lock);
+    data = ioread32(fpga_data->fpga_dev->data_base_addr + REGISTER);
+    mutex_unlock(&fpga_data->fpga_dev->fpga_lock);
+    return sprintf(buf, "%d\n", (data >> 0) & 1U);
+}
+
+/**
+ * Show the FPGA interrupt in use
+ * @param  buf  '<msix|msi|intx|none> <irq> <i2c interrupts> <port interrupts>'
+ * @return      number of bytes read, or an error code
+ */
+static ssize_t irq_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct switchboard_fpga_data *fpga_data = kobj_to_fpga_data(&dev->kobj);
+
+    return sprintf(buf, "%s %d %ld %lu\n",
+                   fpga_data->irq ? fpga_data->fpga_dev->irq_type : "none",
+                   fpga_data->irq, atomic_long_read(&fpga_data->irq_i2c_count),
+                   fpga_data->irq_port_count);
+}
+
+/* FPGA attributes */
+static DEVICE_ATTR( getreg, 0600, get_fpga_reg_value, set_fpga_reg_address);
+static DEVICE_ATTR( scratch, 0600, get_fpga_scratch, set_fpga_scratch);
+static DEVICE_ATTR( setreg, 0200, NULL , set_fpga_reg_value);
+static DEVICE_ATTR_RO(ready);
+static DEVICE_ATTR_RO(irq);
+static BIN_ATTR_RO( dump, PORT_XCVR_REGISTER_SIZE);
+
+static struct bin_attribute *fpga_bin_attrs[] = {
+    &bin_attr_dump,
+    NULL,
+};
+
+static struct attribute *fpga_attrs[] = {
+    &dev_attr_getreg.attr,
+    &dev_attr_scratch.attr,
+    &dev_attr_setreg.attr,
+    &dev_attr_ready.attr,
+    &dev_attr_irq.attr,
+    NULL,
+};
+
+static struct attribute_group fpga_attr_grp = {
+    .attrs = fpga_attrs,
+    .bin_attrs = fpga_bin_attrs,
+};
+
+/* Switch CPLD register map */
+
+/**
+ * Write consecutive switch CPLD registers.
+ * Runs of more than one register go out as I2C block writes of up to
+ * I2C_SMBUS_BLOCK_MAX bytes each.
+ * @param  context  struct switch_cpld of the target CPLD
+ * @param  data     register address followed by the values
+ * @param  count    length of data in bytes
+ * @return          0 on success, or an error code
+ */
+static int switch_cpld_reg_write(void *context, const void *data, size_t count)
+{
+    struct switch_cpld *cpld = context;
+    struct i2c_adapter *adapter = cpld->fpga_data->i2c_adapter[cpld->fpga_data->topo->cpld_bus];
+    const uint8_t *val = data;
+    union i2c_smbus_data smbus_data;
+    uint8_t reg;
+    size_t len;
+    int err;
+
+    if (!adapter)
+        return -ENODEV;
+    if (count < 2)
+        return -EINVAL;
+
+    reg = val[0];
+    val++;
+    count--;
+    while (count) {
+        len = min_t(size_t, count, I2C_SMBUS_BLOCK_MAX);
+        if (len == 1) {
+            smbus_data.byte = val[0];
+            err = fpga_i2c_access(adapter, cpld->slave_addr, 0x00, I2C_SMBUS_WRITE,
+                                  reg, I2C_SMBUS_BYTE_DATA, &smbus_data);
+        } else {
+            smbus_data.block[0] = len;
+            memcpy(&smbus_data.block[1], val, len);
+            err = fpga_i2c_access(adapter, cpld->slave_addr, 0x00, I2C_SMBUS_WRITE,
+                                  reg, I2C_SMBUS_I2C_BLOCK_DATA, &smbus_data);
+        }
+        if (err < 0)
+            return err;
+        reg += len;
+        val += len;
+        count -= len;
+    }
+    return 0;
+}
+
+/**
+ * Read consecutive switch CPLD registers, using I2C block reads for runs.
+ * @param  context   struct switch_cpld of the target CPLD
+ * @param  reg_buf   one byte register address
+ * @param  val_buf   buffer for the register values
+ * @param  val_size  number of registers to read
+ * @return           0 on success, or an error code
+ */
+static int switch_cpld_reg_read(void *context, const void *reg_buf, size_t reg_size,
+                                void *val_buf, size_t val_size)
+{
+    struct switch_cpld *cpld = context;
+    struct i2c_adapter *adapter = cpld->fpga_data->i2c_adapter[cpld->fpga_data->topo->cpld_bus];
+    union i2c_smbus_data smbus_data;
+    uint8_t *val = val_buf;
+    uint8_t reg;
+    size_t len;
+    int err;
+
+    if (!adapter)
+        return -ENODEV;
+    if (reg_size != 1)
+        return -EINVAL;
+
+    reg = *(const uint8_t *)reg_buf;
+    while (val_size) {
+        len = min_t(size_t, val_size, I2C_SMBUS_BLOCK_MAX);
+        if (len == 1) {
+            err = fpga_i2c_access(adapter, cpld->slave_addr, 0x00, I2C_SMBUS_READ,
+                                  reg, I2C_SMBUS_BYTE_DATA, &smbus_data);
+            if (err < 0)
+                return err;
+            val[0] = smbus_data.byte;
+        } else {
+            smbus_data.block[0] = len;
+            err = fpga_i2c_access(adapter, cpld->slave_addr, 0x00, I2C_SMBUS_READ,
+                                  reg, I2C_SMBUS_I2C_BLOCK_DATA, &smbus_data);
+            if (err < 0)
+                return err;
+            memcpy(val, &smbus_data.block[1], len);
+        }
+        reg += len;
+        val += len;
+        val_size -= len;
+    }
+    return 0;
+}
+
+static const struct regmap_bus switch_cpld_regmap_bus = {
+    .write = switch_cpld_reg_write,
+    .read = switch_cpld_reg_read,
+};
+
+/*
+ * Registers that only change when the driver writes them, or never.
+ * Everything else reflects live port and board state and is volatile.
+ * The scratch register stays volatile since it is used to test the bus.
+ */
+static const struct regmap_range switch_cpld_cached_ranges[] = {
+    regmap_reg_range(CPLD_VERSION, CPLD_VERSION),
+    regmap_reg_range(CPLD_LED_MODE, CPLD_LED_COLOR),
+};
+
+static const struct regmap_access_table switch_cpld_volatile_table = {
+    .no_ranges = switch_cpld_cached_ranges,
+    .n_no_ranges = ARRAY_SIZE(switch_cpld_cached_ranges),
+};
+
+static const struct regmap_range switch_cpld_ro_ranges[] = {
+    regmap_reg_range(CPLD_VERSION, CPLD_VERSION),
+};
+
+static const struct regmap_access_table switch_cpld_wr_table = {
+    .no_ranges = switch_cpld_ro_ranges,
+    .n_no_ranges = ARRAY_SIZE(switch_cpld_ro_ranges),
+};
+
+static const struct regmap_config switch_cpld_regmap_config[] = {
+    {
+        .name = "cpld1",
+        .reg_bits = 8,
+        .val_bits = 8,
+        .max_register = 0xFF,
+        .wr_table = &switch_cpld_wr_table,
+        .volatile_table = &switch_cpld_volatile_table,
+        .cache_type = REGCACHE_RBTREE,
+    },
+    {
+        .name = "cpld2",
+        .reg_bits = 8,
+        .val_bits = 8,
+        .max_register = 0xFF,
+        .wr_table = &switch_cpld_wr_table,
+        .volatile_table = &switch_cpld_volatile_table,
+        .cache_type = REGCACHE_RBTREE,
+    },
+};
+
+/**
+ * Bring the register cache back in line with the switch CPLDs after the
+ * FPGA has reset them. A CPLD still held in reset fails the sync and stays
+ * dirty, so it is retried on the next reset register write.
+ */
+static void switch_cpld_cache_sync(struct switchboard_fpga_data *fpga_data)
+{
+    int i, err;
+
+    for (i = 0; i < ARRAY_SIZE(fpga_data->cpld); i++) {
+        if (!fpga_data->cpld[i].regmap)
+            continue;
+        regcache_mark_dirty(fpga_data->cpld[i].regmap);
+        err = regcache_sync(fpga_data->cpld[i].regmap);
+        if (err < 0)
+            printk(KERN_WARNING "CPLD%d register restore failed: %d\n", i + 1, err);
+    }
+}
+
+/* SW CPLDs attributes */
+static ssize_t cpld1_dump_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct switchboard_fpga_data *fpga_data = kobj_to_fpga_data(&dev->kobj);
+    // CPLD register is one byte
+    unsigned int data;
+    int err;
+    err = regmap_read(fpga_data->cpld[0].regmap, fpga_data->cpld1_read_addr, &data);
+    if (err < 0)
+        return err;
+    return sprintf(buf, "0x%2.2x\n", data);
+}
+static ssize_t cpld1_dump_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct switchboard_fpga_data *fpga_data = kobj_to_fpga_data(&dev->kobj);
+    uint8_t addr;
+    char *last;
+    addr = (uint8_t)strtoul(buf, &last, 16);
+    if (addr == 0 && buf == last) {
+        return -EINVAL;
+    }
+    fpga_data->cpld1_read_addr = addr;
+    return size;
+}
+struct device_attribute dev_attr_cpld1_dump = __ATTR(dump, 0600, cpld1_dump_show, cpld1_dump_store);
+
+static ssize_t cpld1_scratch_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct switchboard_fpga_data *fpga_data = kobj_to_fpga_data(&dev->kobj);
+    // CPLD register is one byte
+    unsigned int data;
+    int err;
+    err = regmap_read(fpga_data->cpld[0].regmap, CPLD_SCRATCH, &data);
+    if (err < 0)
+        return err;
+    return sprintf(buf, "0x%2.2x\n", data);
+}
+static ssize_t cpld1_scratch_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct switchboard_fpga_data *fpga_data = kobj_to_fpga_data(&dev->kobj);
+    // CPLD register is one byte
+    __u8 data;
+    char *last;
+    int err;
+    data = (uint8_t)strtoul(buf, &last, 16);
+    if (data == 0 && buf == last) {
+        return -EINVAL;
+    }
+    err = regmap_write(fpga_data->cpld[0].regmap, CPLD_SCRATCH, data);
+    if (err < 0)
+        return err;
+    return size;
+}
+struct device_attribute dev_attr_cpld1_scratch = __ATTR(scratch, 0600, cpld1_scratch_show, cpld1_scratch_store);
+
+static ssize_t cpld1_setreg_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct switchboard_fpga_data *fpga_data = kobj_to_fpga_data(&dev->kobj);
+
+    uint8_t addr, value;
+    char *tok;
+    char clone[size];
+    char *pclone = clone;
+    int err;
+    char *last;
+
+    strcpy(clone, buf);
+
+    tok = strsep((char**)&pclone, " ");
+    if (tok == NULL) {
+        return -EINVAL;
+    }
+    addr = (uint8_t)strtoul(tok, &last, 16);
+    if (addr == 0 && tok == last) {
+        return -EINVAL;
+    }
+    tok = strsep((char**)&pclone, " ");
+    if (tok == NULL) {
+        return -EINVAL;
+    }
+    value = (uint8_t)strtoul(tok, &last, 16);
+    if (value == 0 && tok == last) {
+        return -EINVAL;
+    }
+
+    err = regmap_write(fpga_data->cpld[0].regmap, addr, value);
+    if (err < 0)
+        return err;
+
+    return size;
+}
+struct device_attribute dev_attr_cpld1_setreg = __ATTR(setreg, 0200, NULL, cpld1_setreg_store);
+
+static struct attribute *cpld1_attrs[] = {
+    &dev_attr_cpld1_dump.attr,
+    &dev_attr_cpld1_scratch.attr,
+    &dev_attr_cpld1_setreg.attr,
+    NULL,
+};
+
+static struct attribute_group cpld1_attr_grp = {
+    .attrs = cpld1_attrs,
+};
+
+static ssize_t cpld2_dump_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct switchboard_fpga_data *fpga_data = kobj_to_fpga_data(&dev->kobj);
+    // CPLD register is one byte
+    unsigned int data;
+    int err;
+    err = regmap_read(fpga_data->cpld[1].regmap, fpga_data->cpld2_read_addr, &data);
+    if (err < 0)
+        return err;
+    return sprintf(buf, "0x%2.2x\n", data);
+}
+
+static ssize_t cpld2_dump_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct switchboard_fpga_data *fpga_data = kobj_to_fpga_data(&dev->kobj);
+    // CPLD register is one byte
+    uint32_t addr;
+    char *last;
+    addr = (uint8_t)strtoul(buf, &last, 16);
+    if (addr == 0 && buf == last) {
+        return -EINVAL;
+    }
+    fpga_data->cpld2_read_addr = addr;
+    return size;
+}
+struct device_attribute dev_attr_cpld2_dump = __ATTR(dump, 0600, cpld2_dump_show, cpld2_dump_store);
+
+static ssize_t cpld2_scratch_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct switchboard_fpga_data *fpga_data = kobj_to_fpga_data(&dev->kobj);
+    // CPLD register is one byte
+    unsigned int data;
+    int err;
+    err = regmap_read(fpga_data->cpld[1].regmap, CPLD_SCRATCH, &data);
+    if (err < 0)
+        return err;
+    return sprintf(buf, "0x%2.2x\n", data);
+}
+
+static ssize_t cpld2_scratch_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct switchboard_fpga_data *fpga_data = kobj_to_fpga_data(&dev->kobj);
+    // CPLD register is one byte
+    __u8 data;
+    char *last;
+    int err;
+
+    data = (uint8_t)strtoul(buf, &last, 16);
+    if (data == 0 && buf == last) {
+        return -EINVAL;
+    }
+    err = regmap_write(fpga_data->cpld[1].regmap, CPLD_SCRATCH, data);
+    if (err < 0)
+        return err;
+    return size;
+}
+struct device_attribute dev_attr_cpld2_scratch = __ATTR(scratch, 0600, cpld2_scratch_show, cpld2_scratch_store);
+
+static ssize_t cpld2_setreg_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct switchboard_fpga_data *fpga_data = kobj_to_fpga_data(&dev->kobj);
+    uint8_t addr, value;
+    char *tok;
+    char clone[size];
+    char *pclone = clone;
+    int err;
+    char *last;
+
+    strcpy(clone, buf);
+
+    tok = strsep((char**)&pclone, " ");
+    if (tok == NULL) {
+        return -EINVAL;
+    }
+    addr = (uint8_t)strtoul(tok, &last, 16);
+    if (addr == 0 && tok == last) {
+        return -EINVAL;
+    }
+    tok = strsep((char**)&pclone, " ");
+    if (tok == NULL) {
+        return -EINVAL;
+    }
+    value = (uint8_t)strtoul(tok, &last, 16);
+    if (value == 0 && tok == last) {
+        return -EINVAL;
+    }
+
+    err = regmap_write(fpga_data->cpld[1].regmap, addr, value);
+    if (err < 0)
+        return err;
+
+    return size;
+}
+struct device_attribute dev_attr_cpld2_setreg = __ATTR(setreg, 0200, NULL, cpld2_setreg_store);
+
+static struct attribute *cpld2_attrs[] = {
+    &dev_attr_cpld2_dump.attr,
+    &dev_attr_cpld2_scratch.attr,
+    &dev_attr_cpld2_setreg.attr,
+    NULL,
+};
+
+static struct attribute_group cpld2_attr_grp = {
+    .attrs = cpld2_attrs,
+};
+
+/**
+ * Update one control bit on every port selected in the port mask.
+ * Each port control register is updated by a single read-modify-write.
+ * The written ports are dropped from a pending pulse of the same bit, so
+ * the end of the pulse does not undo this write.
+ * Caller must hold port_ctrl_lock.
+ * @param  mask    port bitmap, bit 0 is port 1
+ * @param  bit     CTRL_* bit position in the port control register
+ * @param  value   0 to clear the bit, otherwise set it
+ */
+static void sff_port_ctrl_write_locked(struct switchboard_fpga_data *fpga_data, uint64_t mask, unsigned int bit, int value)
+{
+    unsigned int portid;
+    unsigned int REGISTER;
+    u32 data;
+
+    for (portid = 0; portid < fpga_data->topo->sff_ports; portid++) {
+        if (!(mask & BIT_ULL(portid)))
+            continue;
+        REGISTER = SFF_PORT_CTRL_BASE + portid * 0x10;
+        data = ioread32(fpga_data->fpga_dev->data_base_addr + REGISTER);
+        if (!value)
+            data = data & ~( (u32)0x1 << bit);
+        else
+            data = data | ((u32)0x1 << bit);
+        iowrite32(data, fpga_data->fpga_dev->data_base_addr + REGISTER);
+    }
+    if (bit == fpga_data->port_pulse_bit)
+        fpga_data->port_pulse_mask &= ~mask;
+    /* ResetL is active low */
+    if (bit == CTRL_RST)
+        port_ready_update(fpga_data, mask, value ? PORT_INITIALIZING : PORT_IN_RESET);
+}
+
+static void sff_port_ctrl_write(struct switchboard_fpga_data *fpga_data, uint64_t mask, unsigned int bit, int value)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&fpga_data->port_ctrl_lock, flags);
+    sff_port_ctrl_write_locked(fpga_data, mask, bit, value);
+    spin_unlock_irqrestore(&fpga_data->port_ctrl_lock, flags);
+}
+
+/**
+ * Read one port status or control register under port_ctrl_lock, the lock
+ * the control register read-modify-writes are done under.
+ * @param  base    SFF_PORT_STATUS_BASE or SFF_PORT_CTRL_BASE
+ * @param  portid  port index, 0 is port 1
+ * @return         register value
+ */
+static u32 sff_port_reg_read(struct switchboard_fpga_data *fpga_data, unsigned int base, unsigned int portid)
+{
+    unsigned long flags;
+    u32 data;
+
+    spin_lock_irqsave(&fpga_data->port_ctrl_lock, flags);
+    data = ioread32(fpga_data->fpga_dev->data_base_addr + base + portid * 0x10);
+    spin_unlock_irqrestore(&fpga_data->port_ctrl_lock, flags);
+    return data;
+}
+
+/**
+ * Collect one control bit of all ports into a port bitmap.
+ * @param  bit     CTRL_* bit position in the port control register
+ * @return         port bitmap, bit 0 is port 1
+ */
+static uint64_t sff_port_ctrl_read(struct switchboard_fpga_data *fpga_data, unsigned int bit)
+{
+    unsigned int portid;
+    unsigned int REGISTER;
+    uint64_t mask = 0;
+    unsigned long flags;
+    u32 data;
+
+    spin_lock_irqsave(&fpga_data->port_ctrl_lock, flags);
+    for (portid = 0; portid < fpga_data->topo->sff_ports; portid++) {
+        REGISTER = SFF_PORT_CTRL_BASE + portid * 0x10;
+        data = ioread32(fpga_data->fpga_dev->data_base_addr + REGISTER);
+        if ((data >> bit) & 1U)
+            mask |= BIT_ULL(portid);
+    }
+    spin_unlock_irqrestore(&fpga_data->port_ctrl_lock, flags);
+    return mask;
+}
+
+/**
+ * End of a control pulse started from the bulk port control attributes.
+ * Runs in hard interrupt context, so the control registers are restored
+ * right when the pulse width expires.
+ */
+static enum hrtimer_restart sff_port_pulse_end(struct hrtimer *timer)
+{
+    struct switchboard_fpga_data *fpga_data =
+        container_of(timer, struct switchboard_fpga_data, port_pulse_timer);
+    unsigned long flags;
+
+    spin_lock_irqsave(&fpga_data->port_ctrl_lock, flags);
+    sff_port_ctrl_write_locked(fpga_data, fpga_data->port_pulse_mask,
+                               fpga_data->port_pulse_bit,
+                               !fpga_data->port_pulse_value);
+    fpga_data->port_pulse_mask = 0;
+    spin_unlock_irqrestore(&fpga_data->port_ctrl_lock, flags);
+    return HRTIMER_NORESTART;
+}
+
+/* Port readiness */
+
+static bool port_is_present(enum PORT_TYPE port_type, u32 status)
+{
+    if (port_type == QSFP)
+        return status & (1U << STAT_PRESENT);
+    return !(status & (1U << STAT_MODABS));
+}
+
+static bool port_is_ready(struct switchboard_fpga_data *fpga_data, unsigned int portid)
+{
+    return ACCESS_ONCE(fpga_data->port_ready[portid].state) == PORT_READY;
+}
+
+/**
+ * Move ports to a new readiness state. Safe from any context.
+ * Initializing a port starts its t_init clock, an absent port is left
+ * ready since there is nothing to wait for.
+ * @param  ports   port bitmap, bit 0 is port 1
+ * @param  state   new state
+ */
+static void port_ready_update(struct switchboard_fpga_data *fpga_data, uint64_t ports,
+                              enum port_ready_state state)
+{
+    struct port_ready *st;
+    unsigned long flags;
+    unsigned int portid, init_ms;
+    enum PORT_TYPE port_type;
+    u32 status;
+
+    spin_lock_irqsave(&fpga_data->ready_lock, flags);
+    for (portid = 0; portid < fpga_data->topo->sff_ports; portid++) {
+        if (!(ports & BIT_ULL(portid)))
+            continue;
+        st = &fpga_data->port_ready[portid];
+        port_type = fpga_data->topo->buses[portid].port_type;
+        if (state == PORT_INITIALIZING) {
+            status = ioread32(fpga_data->fpga_dev->data_base_addr +
+                              SFF_PORT_STATUS_BASE + portid * 0x10);
+            if (!port_is_present(port_type, status)) {
+                st->state = PORT_READY;
+                continue;
+            }
+            init_ms = port_type == QSFP ? PORT_READY_QSFP_INIT_MS : PORT_READY_SFP_INIT_MS;
+            st->deadline = jiffies + msecs_to_jiffies(init_ms);
+            st->next_poll = jiffies + msecs_to_jiffies(PORT_READY_POLL_MS);
+        }
+        st->state = state;
+    }
+    spin_unlock_irqrestore(&fpga_data->ready_lock, flags);
+
+    if (state == PORT_READY)
+        wake_up_all(&fpga_data->ready_wait);
+    else if (state == PORT_INITIALIZING)
+        mod_delayed_work(system_wq, &fpga_data->ready_work,
+                         msecs_to_jiffies(PORT_READY_POLL_MS));
+}
+
+/**
+ * Follow initializing ports until they are ready. A QSFP is ready once its
+ * Data_Not_Ready flag reads clear, any port once its t_init has passed.
+ */
+static void port_ready_work(struct work_struct *work)
+{
+    struct switchboard_fpga_data *fpga_data =
+        container_of(to_delayed_work(work), struct switchboard_fpga_data, ready_work);
+    struct port_ready *st;
+    union i2c_smbus_data data;
+    unsigned long flags, deadline, next_poll;
+    enum port_ready_state state;
+    unsigned int portid;
+    bool ready, pending = false, woke = false;
+    int err;
+
+    for (portid = 0; portid < fpga_data->topo->sff_ports; portid++) {
+        st = &fpga_data->port_ready[portid];
+        spin_lock_irqsave(&fpga_data->ready_lock, flags);
+        state = st->state;
+        deadline = st->deadline;
+        next_poll = st->next_poll;
+        spin_unlock_irqrestore(&fpga_data->ready_lock, flags);
+        if (state != PORT_INITIALIZING)
+            continue;
+
+        ready = time_after_eq(jiffies, deadline);
+        if (!ready && time_after_eq(jiffies, next_poll) &&
+                fpga_data->topo->buses[portid].port_type == QSFP &&
+                fpga_data->i2c_adapter[portid]) {
+            err = fpga_i2c_xfer(fpga_data->i2c_adapter[portid], SFF_EEPROM_ADDR, 0,
+                                I2C_SMBUS_READ, SFF8636_STATUS, I2C_SMBUS_BYTE_DATA, &data);
+            ready = err == 0 && !(data.byte & SFF8636_DATA_NOT_READY);
+        }
+
+        spin_lock_irqsave(&fpga_data->ready_lock, flags);
+        if (st->state == PORT_INITIALIZING) {
+            if (ready) {
+                st->state = PORT_READY;
+            } else {
+                if (time_after_eq(jiffies, st->next_poll))
+                    st->next_poll = jiffies + msecs_to_jiffies(PORT_READY_POLL_MS);
+                pending = true;
+            }
+        }
+        spin_unlock_irqrestore(&fpga_data->ready_lock, flags);
+
+        if (ready && fpga_data->sff_devices[portid]) {
+            sysfs_notify(&fpga_data->sff_devices[portid]->kobj, NULL, "ready");
+            woke = true;
+        }
+    }
+    if (woke)
+        wake_up_all(&fpga_data->ready_wait);
+    if (pending)
+        schedule_delayed_work(&fpga_data->ready_work, msecs_to_jiffies(PORT_READY_POLL_MS));
+}
+
+/**
+ * Hold an access to a port module until it is ready.
+ * @return         0 when ready, -EAGAIN if it is not ready in time, or
+ *                 -ERESTARTSYS if interrupted
+ */
+static int port_ready_gate(struct switchboard_fpga_data *fpga_data, unsigned int portid)
+{
+    unsigned int wait_ms = ACCESS_ONCE(fpga_data->ready_wait_ms);
+    long left;
+
+    if (port_is_ready(fpga_data, portid))
+        return 0;
+    if (!wait_ms)
+        return -EAGAIN;
+    left = wait_event_interruptible_timeout(fpga_data->ready_wait,
+                                            port_is_ready(fpga_data, portid),
+                                            msecs_to_jiffies(wait_ms));
+    if (left < 0)
+        return left;
+    return left ? 0 : -EAGAIN;
+}
+
+/* Port status history */
+
+/**
+ * Read the status of one port and record it in the port history ring if
+ * any status bit changed since the last look.
+ * @param  portid  port index, from 0
+ * @param  ts      time the change was seen at
+ */
+static void port_history_sample(struct switchboard_fpga_data *fpga_data, unsigned int portid, ktime_t ts)
+{
+    struct port_history *hist = &fpga_data->history[portid];
+    struct port_history_entry *ent;
+    unsigned long flags;
+    unsigned int REGISTER = SFF_PORT_STATUS_BASE + portid * 0x10;
+    u16 status, changed;
+    u32 seq;
+
+    status = ioread32(fpga_data->fpga_dev->data_base_addr + REGISTER) & STAT_MSK;
+
+    spin_lock_irqsave(&fpga_data->history_lock, flags);
+    changed = status ^ hist->status;
+    if (!changed) {
+        spin_unlock_irqrestore(&fpga_data->history_lock, flags);
+        return;
+    }
+    ent = &hist->entry[hist->head];
+    ent->ts = ktime_to_ns(ts);
+    seq = ++hist->seq;
+    ent->seq = seq;
+    ent->status = status;
+    ent->changed = changed;
+    hist->status = status;
+    hist->head = (hist->head + 1) % PORT_HISTORY_LEN;
+    spin_unlock_irqrestore(&fpga_data->history_lock, flags);
+
+    trace_switchboard_port_status(fpga_data->topo->buses[portid].calling_name,
+                                  seq, status, changed, ktime_to_ns(ts));
+
+    if (changed & ((1U << STAT_PRESENT) | (1U << STAT_MODABS)))
+        port_ready_update(fpga_data, BIT_ULL(portid),
+                          port_is_present(fpga_data->topo->buses[portid].port_type, status) ?
+                          PORT_INITIALIZING : PORT_READY);
+}
+
+/**
+ * Sample every port from the kernel, when no FPGA interrupt reports the
+ * port changes.
+ */
+static void port_history_work(struct work_struct *work)
+{
+    struct switchboard_fpga_data *fpga_data =
+        container_of(to_delayed_work(work), struct switchboard_fpga_data, history_work);
+    ktime_t now = ktime_get();
+    unsigned int portid;
+
+    for (portid = 0; portid < fpga_data->topo->sff_ports; portid++)
+        port_history_sample(fpga_data, portid, now);
+    if (fpga_data->history_sample_ms)
+        schedule_delayed_work(&fpga_data->history_work,
+                              msecs_to_jiffies(fpga_data->history_sample_ms));
+}
+
+/**
+ * Read the port status history in binary mode.
+ * @param  buf   struct port_history_entry records, oldest first. Slots
+ *               not used yet read as zero.
+ * @return       number of bytes read, or an error code
+ */
+static ssize_t event_history_read(struct file *filp, struct kobject *kobj,
+                                  struct bin_attribute *attr, char *buf,
+                                  loff_t off, size_t count)
+{
+    struct sff_device_data *dev_data = dev_get_drvdata(kobj_to_dev(kobj));
+    struct switchboard_fpga_data *fpga_data = dev_data->fpga_data;
+    struct port_history *hist = &fpga_data->history[dev_data->portid - 1];
+    struct port_history_entry *snap;
+    unsigned long flags;
+    unsigned int head;
+
+    if (off >= sizeof(hist->entry))
+        return 0;
+    count = min_t(size_t, count, sizeof(hist->entry) - off);
+
+    snap = kmalloc(sizeof(hist->entry), GFP_KERNEL);
+    if (!snap)
+        return -ENOMEM;
+    spin_lock_irqsave(&fpga_data->history_lock, flags);
+    head = hist->head;
+    memcpy(snap, &hist->entry[head], (PORT_HISTORY_LEN - head) * sizeof(*snap));
+    memcpy(&snap[PORT_HISTORY_LEN - head], hist->entry, head * sizeof(*snap));
+    spin_unlock_irqrestore(&fpga_data->history_lock, flags);
+
+    memcpy(buf, (char *)snap + off, count);
+    kfree(snap);
+    return count;
+}
+static BIN_ATTR_RO(event_history, sizeof(struct port_history_entry) * PORT_HISTORY_LEN);
+
+/* QSFP/SFP+ attributes */
+static ssize_t qsfp_modirq_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct sff_device_data *dev_data = dev_get_drvdata(dev);
+    u32 data = sff_port_reg_read(dev_data->fpga_data, SFF_PORT_STATUS_BASE, dev_data->portid - 1);
+
+    return sprintf(buf, "%d\n", (data >> STAT_IRQ) & 1U);
+}
+DEVICE_ATTR_RO(qsfp_modirq);
+
+static ssize_t qsfp_modprs_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct sff_device_data *dev_data = dev_get_drvdata(dev);
+    u32 data = sff_port_reg_read(dev_data->fpga_data, SFF_PORT_STATUS_BASE, dev_data->portid - 1);
+
+    return sprintf(buf, "%d\n", (data >> STAT_PRESENT) & 1U);
+}
+DEVICE_ATTR_RO(qsfp_modprs);
+
+static ssize_t sfp_txfault_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct sff_device_data *dev_data = dev_get_drvdata(dev);
+    u32 data = sff_port_reg_read(dev_data->fpga_data, SFF_PORT_STATUS_BASE, dev_data->portid - 1);
+
+    return sprintf(buf, "%d\n", (data >> STAT_TXFAULT) & 1U);
+}
+DEVICE_ATTR_RO(sfp_txfault);
+
+static ssize_t sfp_rxlos_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct sff_device_data *dev_data = dev_get_drvdata(dev);
+    u32 data = sff_port_reg_read(dev_data->fpga_data, SFF_PORT_STATUS_BASE, dev_data->portid - 1);
+
+    return sprintf(buf, "%d\n", (data >> STAT_RXLOS) & 1U);
+}
+DEVICE_ATTR_RO(sfp_rxlos);
+
+static ssize_t sfp_modabs_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct sff_device_data *dev_data = dev_get_drvdata(dev);
+    u32 data = sff_port_reg_read(dev_data->fpga_data, SFF_PORT_STATUS_BASE, dev_data->portid - 1);
+
+    return sprintf(buf, "%d\n", (data >> STAT_MODABS) & 1U);
+}
+DEVICE_ATTR_RO(sfp_modabs);
+
+static ssize_t qsfp_lpmode_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct sff_device_data *dev_data = dev_get_drvdata(dev);
+    u32 data = sff_port_reg_read(dev_data->fpga_data, SFF_PORT_CTRL_BASE, dev_data->portid - 1);
+
+    return sprintf(buf, "%d\n", (data >> CTRL_LPMOD) & 1U);
+}
+static ssize_t qsfp_lpmode_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    ssize_t status;
+    long value;
+    struct sff_device_data *dev_data = dev_get_drvdata(dev);
+    struct switchboard_fpga_data *fpga_data = dev_data->fpga_data;
+    unsigned int portid = dev_data->portid;
+
+    status = kstrtol(buf, 0, &value);
+    if (status != 0)
+        return status;
+    // if value is 0, disable the lpmode
+    sff_port_ctrl_write(fpga_data, BIT_ULL(portid - 1), CTRL_LPMOD, value);
+    return size;
+}
+DEVICE_ATTR_RW(qsfp_lpmode);
+
+static ssize_t qsfp_reset_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct sff_device_data *dev_data = dev_get_drvdata(dev);
+    u32 data = sff_port_reg_read(dev_data->fpga_data, SFF_PORT_CTRL_BASE, dev_data->portid - 1);
+
+    return sprintf(buf, "%d\n", (data >> CTRL_RST) & 1U);
+}
+
+static ssize_t qsfp_reset_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    ssize_t status;
+    long value;
+    struct sff_device_data *dev_data = dev_get_drvdata(dev);
+    struct switchboard_fpga_data *fpga_data = dev_data->fpga_data;
+    unsigned int portid = dev_data->portid;
+
+    status = kstrtol(buf, 0, &value);
+    if (status != 0)
+        return status;
+    // if value is 0, reset signal is low
+    sff_port_ctrl_write(fpga_data, BIT_ULL(portid - 1), CTRL_RST, value);
+    return size;
+}
+DEVICE_ATTR_RW(qsfp_reset);
+
+static ssize_t sfp_txdisable_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct sff_device_data *dev_data = dev_get_drvdata(dev);
+    u32 data = sff_port_reg_read(dev_data->fpga_data, SFF_PORT_CTRL_BASE, dev_data->portid - 1);
+
+    return sprintf(buf, "%d\n", (data >> CTRL_TXDIS) & 1U);
+}
+static ssize_t sfp_txdisable_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    ssize_t status;
+    long value;
+    struct sff_device_data *dev_data = dev_get_drvdata(dev);
+    struct switchboard_fpga_data *fpga_data = dev_data->fpga_data;
+    unsigned int portid = dev_data->portid;
+
+    status = kstrtol(buf, 0, &value);
+    if (status != 0)
+        return status;
+    // check if value is 0 clear
+    sff_port_ctrl_write(fpga_data, BIT_ULL(portid - 1), CTRL_TXDIS, value);
+    return size;
+}
+DEVICE_ATTR_RW(sfp_txdisable);
+
+/**
+ * Show if the module management interface is ready. Pollable.
+ * @param  buf  1 if ready, 0 while in reset or initializing
+ * @return      number of bytes read, or an error code
+ */
+static ssize_t ready_port_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct sff_device_data *dev_data = dev_get_drvdata(dev);
+    return sprintf(buf, "%d\n", port_is_ready(dev_data->fpga_data, dev_data->portid - 1));
+}
+struct device_attribute dev_attr_port_ready = __ATTR(ready, 0444, ready_port_show, NULL);
+
+static struct attribute *sff_attrs[] = {
+    &dev_attr_qsfp_modirq.attr,
+    &dev_attr_qsfp_modprs.attr,
+    &dev_attr_qsfp_lpmode.attr,
+    &dev_attr_qsfp_reset.attr,
+    &dev_attr_sfp_txfault.attr,
+    &dev_attr_sfp_rxlos.attr,
+    &dev_attr_sfp_modabs.attr,
+    &dev_attr_sfp_txdisable.attr,
+    &dev_attr_port_ready.attr,
+    NULL,
+};
+
+static struct bin_attribute *sff_bin_attrs[] = {
+    &bin_attr_event_history,
+    NULL,
+};
+
+static struct attribute_group sff_attr_grp = {
+    .attrs = sff_attrs,
+    .bin_attrs = sff_bin_attrs,
+};
+
+static const struct attribute_group *sff_attr_grps[] = {
+    &sff_attr_grp,
+    NULL
+};
+
+
+/* Bulk port control attributes */
+
+/**
+ * Apply a control signal to many ports at once.
+ * @param  buf     '<port mask> <value> [<pulse width us>]' where bit 0 of
+ *                 the hex port mask is port 1. When a pulse width is given,
+ *                 the inverse value is written back by a hrtimer once the
+ *                 pulse width expires.
+ * @return         number of bytes stored, or an error code
+ */
+static ssize_t sff_port_ctrl_store(struct device *dev, const char *buf, size_t size, unsigned int bit)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    unsigned long long mask;
+    unsigned int value;
+    unsigned int pulse_us = 0;
+    unsigned long flags;
+    int items;
+
+    items = sscanf(buf, "%llx %u %u", &mask, &value, &pulse_us);
+    if (items < 2)
+        return -EINVAL;
+    if (mask & ~GENMASK_ULL(fpga_data->topo->sff_ports - 1, 0))
+        return -EINVAL;
+    if (pulse_us > SFF_PORT_PULSE_MAX_US)
+        return -EINVAL;
+
+    spin_lock_irqsave(&fpga_data->port_ctrl_lock, flags);
+    if (pulse_us && fpga_data->port_pulse_mask) {
+        spin_unlock_irqrestore(&fpga_data->port_ctrl_lock, flags);
+        return -EBUSY;
+    }
+    sff_port_ctrl_write_locked(fpga_data, mask, bit, value);
+    if (pulse_us) {
+        fpga_data->port_pulse_mask = mask;
+        fpga_data->port_pulse_bit = bit;
+        fpga_data->port_pulse_value = value;
+        hrtimer_start(&fpga_data->port_pulse_timer,
+                      ns_to_ktime((u64)pulse_us * NSEC_PER_USEC),
+                      HRTIMER_MODE_REL);
+    }
+    spin_unlock_irqrestore(&fpga_data->port_ctrl_lock, flags);
+    return size;
+}
+
+static ssize_t port_lpmode_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    return sprintf(buf, "0x%9.9llx\n", sff_port_ctrl_read(dev_get_drvdata(dev), CTRL_LPMOD));
+}
+static ssize_t port_lpmode_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    return sff_port_ctrl_store(dev, buf, size, CTRL_LPMOD);
+}
+DEVICE_ATTR_RW(port_lpmode);
+
+static ssize_t port_reset_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    return sprintf(buf, "0x%9.9llx\n", sff_port_ctrl_read(dev_get_drvdata(dev), CTRL_RST));
+}
+static ssize_t port_reset_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    return sff_port_ctrl_store(dev, buf, size, CTRL_RST);
+}
+DEVICE_ATTR_RW(port_reset);
+
+static ssize_t port_txdisable_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    return sprintf(buf, "0x%9.9llx\n", sff_port_ctrl_read(dev_get_drvdata(dev), CTRL_TXDIS));
+}
+static ssize_t port_txdisable_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    return sff_port_ctrl_store(dev, buf, size, CTRL_TXDIS);
+}
+DEVICE_ATTR_RW(port_txdisable);
+
+/**
+ * Show the last batch of port events.
+ * Pollable, notified once per batch.
+ * @param  buf     '<port mask> <batch count>', bit 0 is port 1
+ * @return         number of bytes read, or an error code
+ */
+static ssize_t port_event_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    unsigned long flags;
+    uint64_t mask;
+    unsigned long batches;
+
+    spin_lock_irqsave(&fpga_data->event_lock, flags);
+    mask = fpga_data->event_last;
+    batches = fpga_data->event_batches;
+    spin_unlock_irqrestore(&fpga_data->event_lock, flags);
+    return sprintf(buf, "0x%9.9llx %lu\n", mask, batches);
+}
+DEVICE_ATTR_RO(port_event);
+
+static ssize_t port_event_coalesce_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    return sprintf(buf, "%u\n", fpga_data->event_coalesce_ms);
+}
+
+/**
+ * Set the port event coalescing window.
+ * @param  buf     window in ms from the first event of a batch, 0 notifies
+ *                 every interrupt on its own
+ * @return         number of bytes stored, or an error code
+ */
+static ssize_t port_event_coalesce_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    unsigned int ms;
+    int err;
+
+    err = kstrtouint(buf, 0, &ms);
+    if (err)
+        return err;
+    if (ms > PORT_EVENT_COALESCE_MAX_MS)
+        return -EINVAL;
+    fpga_data->event_coalesce_ms = ms;
+    return size;
+}
+DEVICE_ATTR_RW(port_event_coalesce);
+
+static ssize_t port_history_sample_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    return sprintf(buf, "%u\n", fpga_data->history_sample_ms);
+}
+
+/**
+ * Set the period of the kernel port status sampler feeding event_history.
+ * @param  buf     period in ms, 0 stops the sampler. Port interrupts feed
+ *                 the history regardless.
+ * @return         number of bytes stored, or an error code
+ */
+static ssize_t port_history_sample_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    unsigned int ms;
+    int err;
+
+    err = kstrtouint(buf, 0, &ms);
+    if (err)
+        return err;
+    if (ms > PORT_HISTORY_SAMPLE_MAX_MS)
+        return -EINVAL;
+    cancel_delayed_work_sync(&fpga_data->history_work);
+    fpga_data->history_sample_ms = ms;
+    if (ms)
+        schedule_delayed_work(&fpga_data->history_work, msecs_to_jiffies(ms));
+    return size;
+}
+DEVICE_ATTR_RW(port_history_sample);
+
+static ssize_t port_ready_wait_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    return sprintf(buf, "%u\n", fpga_data->ready_wait_ms);
+}
+
+/**
+ * Set how module accesses behave while a port is not ready.
+ * @param  buf     longest wait in ms, 0 fails the access with -EAGAIN
+ * @return         number of bytes stored, or an error code
+ */
+static ssize_t port_ready_wait_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    unsigned int ms;
+    int err;
+
+    err = kstrtouint(buf, 0, &ms);
+    if (err)
+        return err;
+    if (ms > PORT_READY_WAIT_MAX_MS)
+        return -EINVAL;
+    ACCESS_ONCE(fpga_data->ready_wait_ms) = ms;
+    return size;
+}
+DEVICE_ATTR_RW(port_ready_wait);
+
+static struct attribute *sff_ctrl_attrs[] = {
+    &dev_attr_port_lpmode.attr,
+    &dev_attr_port_reset.attr,
+    &dev_attr_port_txdisable.attr,
+    &dev_attr_port_event.attr,
+    &dev_attr_port_event_coalesce.attr,
+    &dev_attr_port_history_sample.attr,
+    &dev_attr_port_ready_wait.attr,
+    NULL,
+};
+
+static struct attribute_group sff_ctrl_grp = {
+    .attrs = sff_ctrl_attrs,
+};
+
+static ssize_t port_led_mode_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    // value can be "nomal", "test"
+    unsigned int led_mode_1, led_mode_2;
+    int err;
+    err = regmap_read(fpga_data->cpld[0].regmap, CPLD_LED_MODE, &led_mode_1);
+    if (err < 0)
+        return err;
+    err = regmap_read(fpga_data->cpld[1].regmap, CPLD_LED_MODE, &led_mode_2);
+    if (err < 0)
+        return err;
+    return sprintf(buf, "%s %s\n",
+                   led_mode_1 ? "test" : "normal",
+                   led_mode_2 ? "test" : "normal");
+}
+static ssize_t port_led_mode_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    int status;
+    __u8 led_mode_1;
+    if (sysfs_streq(buf, "test")) {
+        led_mode_1 = 0x01;
+    } else if (sysfs_streq(buf, "normal")) {
+        led_mode_1 = 0x00;
+    } else {
+        return -EINVAL;
+    }
+    status = regmap_write(fpga_data->cpld[0].regmap, CPLD_LED_MODE, led_mode_1);
+    status = regmap_write(fpga_data->cpld[1].regmap, CPLD_LED_MODE, led_mode_1);
+    return size;
+}
+DEVICE_ATTR_RW(port_led_mode);
+
+/**
+ * Name of a port LED colour register value, as listed in the board topology.
+ */
+static const char *port_led_color_name(struct switchboard_fpga_data *fpga_data, unsigned int color)
+{
+    if (color >= fpga_data->topo->n_led_colors)
+        return "unknown";
+    return fpga_data->topo->led_colors[color];
+}
+
+// Only work when port_led_mode set to 1
+static ssize_t port_led_color_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    unsigned int led_color1, led_color2;
+    int err;
+    err = regmap_read(fpga_data->cpld[0].regmap, CPLD_LED_COLOR, &led_color1);
+    if (err < 0)
+        return err;
+    err = regmap_read(fpga_data->cpld[1].regmap, CPLD_LED_COLOR, &led_color2);
+    if (err < 0)
+        return err;
+    return sprintf(buf, "%s %s\n",
+                   port_led_color_name(fpga_data, led_color1),
+                   port_led_color_name(fpga_data, led_color2));
+}
+
+static ssize_t port_led_color_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    int status;
+    __u8 led_color;
+
+    for (led_color = 0; led_color < fpga_data->topo->n_led_colors; led_color++) {
+        if (sysfs_streq(buf, fpga_data->topo->led_colors[led_color]))
+            break;
+    }
+    if (led_color == fpga_data->topo->n_led_colors) {
+        status = -EINVAL;
+        return status;
+    }
+    status = regmap_write(fpga_data->cpld[0].regmap, CPLD_LED_COLOR, led_color);
+    status = regmap_write(fpga_data->cpld[1].regmap, CPLD_LED_COLOR, led_color);
+    return size;
+}
+DEVICE_ATTR_RW(port_led_color);
+
+static struct attribute *sff_led_test[] = {
+    &dev_attr_port_led_mode.attr,
+    &dev_attr_port_led_color.attr,
+    NULL,
+};
+
+static struct attribute_group sff_led_test_grp = {
+    .attrs = sff_led_test,
+};
+
+static struct device * switchboard_sff_init(struct switchboard_fpga_data *fpga_data, int portid) {
+    struct sff_device_data *new_data;
+    struct device *new_device;
+
+    new_data = kzalloc(sizeof(*new_data), GFP_KERNEL);
+    if (!new_data) {
+        printk(KERN_ALERT "Cannot alloc sff device data @port%d", portid);
+        return NULL;
+    }
+    /* The QSFP port ID start from 1 */
+    new_data->portid = portid + 1;
+    new_data->port_type = fpga_data->topo->buses[portid].port_type;
+    new_data->fpga_data = fpga_data;
+    new_device = device_create_with_groups(fpga_data->fpga_dev->fpgafwclass, fpga_data->sff_dev, MKDEV(0, 0), new_data, sff_attr_grps, "%s", fpga_data->topo->buses[portid].calling_name);
+    if (IS_ERR(new_device)) {
+        printk(KERN_ALERT "Cannot create sff device @port%d", portid);
+        kfree(new_data);
+        return NULL;
+    }
+    return new_device;
+}
+
+/* Port interrupts */
+
+/**
+ * Add ports to the pending event batch. The first event of a batch opens
+ * the coalescing window, later ones only join it.
+ */
+static void switchboard_port_event(struct switchboard_fpga_data *fpga_data, uint64_t ports)
+{
+    unsigned long flags;
+
+    if (!ports)
+        return;
+    spin_lock_irqsave(&fpga_data->event_lock, flags);
+    fpga_data->event_pending |= ports;
+    spin_unlock_irqrestore(&fpga_data->event_lock, flags);
+    schedule_delayed_work(&fpga_data->event_work,
+                          msecs_to_jiffies(fpga_data->event_coalesce_ms));
+}
+
+/**
+ * Notify a batch of port events, once per port status attribute and once
+ * on port_event for the whole batch.
+ */
+static void switchboard_port_event_work(struct work_struct *work)
+{
+    struct switchboard_fpga_data *fpga_data =
+        container_of(to_delayed_work(work), struct switchboard_fpga_data, event_work);
+    struct sff_device_data *sff_data;
+    struct device *sff;
+    unsigned long flags;
+    unsigned int portid;
+    uint64_t ports;
+
+    spin_lock_irqsave(&fpga_data->event_lock, flags);
+    ports = fpga_data->event_pending;
+    fpga_data->event_pending = 0;
+    fpga_data->event_last = ports;
+    fpga_data->event_batches++;
+    spin_unlock_irqrestore(&fpga_data->event_lock, flags);
+
+    for (portid = 0; portid < fpga_data->topo->sff_ports; portid++) {
+        sff = fpga_data->sff_devices[portid];
+        if (!(ports & BIT_ULL(portid)) || !sff)
+            continue;
+        sff_data = dev_get_drvdata(sff);
+        if (sff_data->port_type == QSFP) {
+            sysfs_notify(&sff->kobj, NULL, "qsfp_modprs");
+            sysfs_notify(&sff->kobj, NULL, "qsfp_modirq");
+        } else {
+            sysfs_notify(&sff->kobj, NULL, "sfp_modabs");
+            sysfs_notify(&sff->kobj, NULL, "sfp_rxlos");
+            sysfs_notify(&sff->kobj, NULL, "sfp_txfault");
+        }
+    }
+    sysfs_notify(&fpga_data->sff_dev->kobj, NULL, "port_event");
+}
+
+/**
+ * Hard interrupt half. Wakes the I2C masters that finished a transfer right
+ * away and hands port events to the thread, masking them meanwhile.
+ */
+static irqreturn_t switchboard_irq(int irq, void *dev_id)
+{
+    struct switchboard_fpga_data *fpga_data = dev_id;
+    void __iomem *base = fpga_data->fpga_dev->data_base_addr;
+    irqreturn_t ret = IRQ_HANDLED;
+    u32 status, mask;
+    int ch;
+
+    spin_lock(&fpga_data->irq_lock);
+    mask = ioread32(base + FPGA_INT_MASK);
+    status = ioread32(base + FPGA_INT_STATUS) & ~mask;
+    if (!status) {
+        spin_unlock(&fpga_data->irq_lock);
+        return IRQ_NONE;
+    }
+    if (status & BIT(INT_PORT)) {
+        iowrite32(mask | BIT(INT_PORT), base + FPGA_INT_MASK);
+        fpga_data->irq_ts = ktime_get();
+        ret = IRQ_WAKE_THREAD;
+    }
+    spin_unlock(&fpga_data->irq_lock);
+
+    status &= INT_I2C_MSK;
+    if (status) {
+        iowrite32(status, base + FPGA_INT_FLAG);
+        for (ch = 0; ch < fpga_data->topo->i2c_masters; ch++) {
+            if (status & BIT(ch))
+                wake_up(&fpga_data->i2c_master[ch].wait);
+        }
+        atomic_long_inc(&fpga_data->irq_i2c_count);
+    }
+    return ret;
+}
+
+/**
+ * Threaded half. Finds the ports behind a port interrupt through the port
+ * group status, acknowledges them and queues the event batch.
+ */
+static irqreturn_t switchboard_irq_thread(int irq, void *dev_id)
+{
+    struct switchboard_fpga_data *fpga_data = dev_id;
+    void __iomem *base = fpga_data->fpga_dev->data_base_addr;
+    unsigned int portid;
+    unsigned int REGISTER;
+    unsigned long flags;
+    uint64_t ports = 0;
+    u32 groups, data;
+
+    groups = ioread32(base + FPGA_INT_SRC_STATUS);
+    iowrite32(BIT(INT_PORT), base + FPGA_INT_FLAG);
+    for (portid = 0; portid < fpga_data->topo->sff_ports; portid++) {
+        if (!(groups & BIT(portid / INT_PORT_GROUP_SIZE)))
+            continue;
+        REGISTER = SFF_PORT_INT_STATUS_BASE + portid * 0x10;
+        data = ioread32(base + REGISTER);
+        if (!data)
+            continue;
+        iowrite32(data, base + REGISTER);
+        port_history_sample(fpga_data, portid, fpga_data->irq_ts);
+        ports |= BIT_ULL(portid);
+    }
+    fpga_data->irq_port_count++;
+    switchboard_port_event(fpga_data, ports);
+
+    spin_lock_irqsave(&fpga_data->irq_lock, flags);
+    iowrite32(ioread32(base + FPGA_INT_MASK) & ~BIT(INT_PORT), base + FPGA_INT_MASK);
+    spin_unlock_irqrestore(&fpga_data->irq_lock, flags);
+    return IRQ_HANDLED;
+}
+
+/**
+ * Take the FPGA interrupt allocated by the PCI probe. Without one, or if it
+ * cannot be requested, I2C transfers keep polling and no port events are
+ * reported.
+ */
+static void switchboard_irq_init(struct platform_device *pdev)
+{
+    struct switchboard_fpga_data *fpga_data = platform_get_drvdata(pdev);
+    struct fpga_device *fpga_dev = fpga_data->fpga_dev;
+    void __iomem *base = fpga_dev->data_base_addr;
+    unsigned int portid;
+    unsigned int REGISTER;
+    int err;
+
+    if (fpga_dev->irq <= 0)
+        return;
+
+    /* Drop anything latched before the handler existed, then unmask ports */
+    for (portid = 0; portid < fpga_data->topo->sff_ports; portid++) {
+        REGISTER = SFF_PORT_INT_STATUS_BASE + portid * 0x10;
+        iowrite32(ioread32(base + REGISTER), base + REGISTER);
+        iowrite32(0, base + SFF_PORT_INT_MASK_BASE + portid * 0x10);
+    }
+    iowrite32(0xffffffff, base + FPGA_INT_FLAG);
+
+    err = request_threaded_irq(fpga_dev->irq, switchboard_irq, switchboard_irq_thread,
+                               IRQF_SHARED, dev_name(&pdev->dev), fpga_data);
+    if (err < 0) {
+        dev_warn(&pdev->dev, "cannot request irq %d: %d, polling\n", fpga_dev->irq, err);
+        return;
+    }
+    fpga_data->irq = fpga_dev->irq;
+    iowrite32(~(BIT(INT_PORT) | GENMASK(fpga_data->topo->i2c_masters - 1, 0)),
+              base + FPGA_INT_MASK);
+    dev_info(&pdev->dev, "using %s irq %d\n", fpga_dev->irq_type, fpga_data->irq);
+}
+
+static void switchboard_irq_exit(struct switchboard_fpga_data *fpga_data)
+{
+    if (!fpga_data->irq)
+        return;
+    iowrite32(0xffffffff, fpga_data->fpga_dev->data_base_addr + FPGA_INT_MASK);
+    free_irq(fpga_data->irq, fpga_data);
+    fpga_data->irq = 0;
+}
+
+/**
+ * Transfer state an I2C master waits for: interrupt flag set, or transfer
+ * complete when reading.
+ */
+static bool i2c_master_done(void __iomem *reg_sr, int writing)
+{
+    u8 status = ioread8(reg_sr);
+
+    if (status & (1 << I2C_SR_BIT_MIF))
+        return true;
+    return writing == 0 && (status & (1 << I2C_SR_BIT_MCF));
+}
+
+static int i2c_wait_ack(struct i2c_adapter *a, unsigned long timeout, int writing) {
+    int error = 0;
+    int Status;
+
+    struct i2c_dev_data *new_data = i2c_get_adapdata(a);
+    void __iomem *pci_bar = new_data->fpga_data->fpga_dev->data_base_addr;
+    struct fpga_i2c_master *master;
+
+    unsigned int REG_FDR0;
+    unsigned int REG_CR0;
+    unsigned int REG_SR0;
+    unsigned int REG_DR0;
+    unsigned int REG_ID0;
+
+    unsigned int master_bus = new_data->pca9548.master_bus;
+
+    if (master_bus < I2C_MASTER_CH_1 || master_bus > new_data->fpga_data->topo->i2c_masters) {
+        error = -ENXIO;
+        return error;
+    }
+
+    REG_FDR0  = I2C_MASTER_FREQ_1    + (master_bus - 1) * 0x0100;
+    REG_CR0   = I2C_MASTER_CTRL_1    + (master_bus - 1) * 0x0100;
+    REG_SR0   = I2C_MASTER_STATUS_1  + (master_bus - 1) * 0x0100;
+    REG_DR0   = I2C_MASTER_DATA_1    + (master_bus - 1) * 0x0100;
+    REG_ID0   = I2C_MASTER_PORT_ID_1 + (master_bus - 1) * 0x0100;
+
+    master = &new_data->fpga_data->i2c_master[master_bus - 1];
+
+    check(pci_bar + REG_SR0);
+    check(pci_bar + REG_CR0);
+
+    timeout = jiffies + msecs_to_jiffies(timeout);
+    while (1) {
+        Status = ioread8(pci_bar + REG_SR0);
+        if (jiffies > timeout) {
+            info("Status %2.2X", Status);
+            info("Error Timeout");
+            error = -ETIMEDOUT;
+            break;
+        }
+
+
+        if (Status & (1 << I2C_SR_BIT_MIF)) {
+            break;
+        }
+
+        if (writing == 0 && (Status & (1 << I2C_SR_BIT_MCF))) {
+            break;
+        }
+
+        /*
+         * With use_irq, sleep until the transfer done interrupt. Each wait
+         * is cut to one jiffy, so a lost interrupt only costs latency.
+         * Without it, the default, keep polling the status register.
+         */
+        if (new_data->fpga_data->irq)
+            wait_event_timeout(master->wait, i2c_master_done(pci_bar + REG_SR0, writing), 1);
+    }
+    Status = ioread8(pci_bar + REG_SR0);
+    iowrite8(0, pci_bar + REG_SR0);
+
+    if (error < 0) {
+        info("Status %2.2X", Status);
+        return error;
+    }
+
+    if (!(Status & (1 << I2C_SR_BIT_MCF))) {
+        info("Error Unfinish");
+        return -EIO;
+    }
+
+    if (Status & (1 << I2C_SR_BIT_MAL)) {
+        info("Error MAL");
+        return -EAGAIN;
+    }
+
+    if (Status & (1 << I2C_SR_BIT_RXAK)) {
+        info( "SL No Acknowlege");
+        if (writing) {
+            info("Error No Acknowlege");
+            iowrite8(1 << I2C_CR_BIT_MEN, pci_bar + REG_CR0);
+            return -ENXIO;
+        }
+    } else {
+        info( "SL Acknowlege");
+    }
+
+    return 0;
+}
+
+/**
+ * SMBus packet error code, CRC-8 with polynomial x^8 + x^2 + x + 1.
+ * @param  crc     running code, 0 at the start of a transaction
+ * @param  p       bytes on the wire
+ * @param  count   number of bytes
+ * @return         updated code
+ */
+static u8 smbus_pec(u8 crc, const u8 *p, size_t count)
+{
+    int i;
+
+    while (count--) {
+        crc ^= *p++;
+        for (i = 0; i < 8; i++)
+            crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+/**
+ * Send one byte and wait for its ACK.
+ * @param  pec     running packet error code, updated with the byte
+ */
+static int smbus_send_byte(struct i2c_adapter *adapter, void __iomem *reg_dr, u8 byte, u8 *pec)
+{
+    iowrite8(byte, reg_dr);
+    *pec = smbus_pec(*pec, &byte, 1);
+    info( "   Data > %2.2X", byte);
+    return i2c_wait_ack(adapter, 12, 1);
+}
+
+static int smbus_access(struct i2c_adapter *adapter, u16 addr,
+                        unsigned short flags, char rw, u8 cmd,
+                        int size, union i2c_smbus_data *data)
+{
+    int error = 0;
+    int cnt = 0;
+    int bid = 0;
+    struct i2c_dev_data *dev_data;
+    void __iomem *pci_bar;
+    unsigned int  portid, master_bus;
+    unsigned int REG_FDR0;
+    unsigned int REG_CR0;
+    unsigned int REG_SR0;
+    unsigned int REG_DR0;
+    unsigned int REG_ID0;
+    u8 buf[I2C_SMBUS_BLOCK_MAX + 2];    // Bytes to send or received, with count and PEC
+    u8 pec = 0;
+    u8 addr_byte;
+    bool use_pec;
+    bool read_back;                     // A read phase follows, also for process calls
+    bool block_read;                    // First byte received is the count
+
+    /* Write the command register */
+    dev_data = i2c_get_adapdata(adapter);
+    portid = dev_data->portid;
+    pci_bar = dev_data->fpga_data->fpga_dev->data_base_addr;
+
+#ifdef DEBUG_KERN
+    printk(KERN_INFO "portid %2d|@ 0x%2.2X|f 0x%4.4X|(%d)%-5s| (%d)%-10s|CMD %2.2X "
+           , portid, addr, flags, rw, rw == 1 ? "READ " : "WRITE"
+           , size,                  size == 0 ? "QUICK" :
+           size == 1 ? "BYTE" :
+           size == 2 ? "BYTE_DATA" :
+           size == 3 ? "WORD_DATA" :
+           size == 4 ? "PROC_CALL" :
+           size == 5 ? "BLOCK_DATA" :
+           size == 7 ? "BLOCK_PROC_CALL" :
+           size == 8 ? "I2C_BLOCK_DATA" :  "ERROR"
+           , cmd);
+#endif
+    /* Map the size to what the chip understands */
+    switch (size) {
+    case I2C_SMBUS_QUICK:
+    case I2C_SMBUS_BYTE:
+    case I2C_SMBUS_BYTE_DATA:
+    case I2C_SMBUS_WORD_DATA:
+    case I2C_SMBUS_PROC_CALL:
+    case I2C_SMBUS_BLOCK_DATA:
+    case I2C_SMBUS_BLOCK_PROC_CALL:
+    case I2C_SMBUS_I2C_BLOCK_DATA:
+        break;
+    default:
+        printk(KERN_INFO "Unsupported transaction %d\n", size);
+        return -EOPNOTSUPP;
+    }
+
+    /* Block lengths come from the caller, check them before touching the bus */
+    if ((size == I2C_SMBUS_BLOCK_DATA && rw == I2C_SMBUS_WRITE) ||
+            size == I2C_SMBUS_BLOCK_PROC_CALL || size == I2C_SMBUS_I2C_BLOCK_DATA) {
+        if (data->block[0] < 1 || data->block[0] > I2C_SMBUS_BLOCK_MAX)
+            return -EINVAL;
+    }
+
+    master_bus = dev_data->pca9548.master_bus;
+
+    if (master_bus < I2C_MASTER_CH_1 || master_bus > dev_data->fpga_data->topo->i2c_masters)
+        return -ENXIO;
+
+    use_pec = (flags & I2C_CLIENT_PEC) && size != I2C_SMBUS_QUICK &&
+              size != I2C_SMBUS_I2C_BLOCK_DATA;
+    read_back = rw == I2C_SMBUS_READ || size == I2C_SMBUS_PROC_CALL ||
+                size == I2C_SMBUS_BLOCK_PROC_CALL;
+    block_read = size == I2C_SMBUS_BLOCK_DATA || size == I2C_SMBUS_BLOCK_PROC_CALL;
+
+    REG_FDR0  = I2C_MASTER_FREQ_1    + (master_bus - 1) * 0x0100;
+    REG_CR0   = I2C_MASTER_CTRL_1    + (master_bus - 1) * 0x0100;
+    REG_SR0   = I2C_MASTER_STATUS_1  + (master_bus - 1) * 0x0100;
+    REG_DR0   = I2C_MASTER_DATA_1    + (master_bus - 1) * 0x0100;
+    REG_ID0   = I2C_MASTER_PORT_ID_1 + (master_bus - 1) * 0x0100;
+
+    iowrite8(portid, pci_bar + REG_ID0);
+
+    ////[S][ADDR/R]
+    //Clear status register
+    iowrite8(0, pci_bar + REG_SR0);
+    iowrite8(1 << I2C_CR_BIT_MIEN | 1 << I2C_CR_BIT_MTX | 1 << I2C_CR_BIT_MSTA , pci_bar + REG_CR0);
+    SET_REG_BIT_H(pci_bar + REG_CR0, I2C_CR_BIT_MEN);
+
+    if (rw == I2C_SMBUS_READ &&
+            (size == I2C_SMBUS_QUICK || size == I2C_SMBUS_BYTE)) {
+        // sent device address with Read mode
+        addr_byte = addr << 1 | 0x01;
+    } else {
+        // sent device address with Write mode
+        addr_byte = addr << 1 | 0x00;
+    }
+
+    info( "MS Start");
+
+    //// Wait {A}
+    error = smbus_send_byte(adapter, pci_bar + REG_DR0, addr_byte, &pec);
+    if (error < 0) {
+        info( "get error %d", error);
+        goto Done;
+    }
+
+    //// [CMD]{A}
+    if (size != I2C_SMBUS_QUICK &&
+            !(size == I2C_SMBUS_BYTE && rw == I2C_SMBUS_READ)) {
+        info( "MS Send CMD 0x%2.2X", cmd);
+        error = smbus_send_byte(adapter, pci_bar + REG_DR0, cmd, &pec);
+        if (error < 0) {
+            info( "get error %d", error);
+            goto Done;
+        }
+    }
+
+    // [CNT][DATA]{A}, the count is only sent in SMBus block modes
+    cnt = 0;
+    if (rw == I2C_SMBUS_WRITE || size == I2C_SMBUS_PROC_CALL ||
+            size == I2C_SMBUS_BLOCK_PROC_CALL) {
+        switch (size) {
+        case I2C_SMBUS_BYTE_DATA:
+            buf[cnt++] = data->byte;
+            break;
+        case I2C_SMBUS_WORD_DATA:
+        case I2C_SMBUS_PROC_CALL:
+            buf[cnt++] = data->word & 0xff;
+            buf[cnt++] = data->word >> 8;
+            break;
+        case I2C_SMBUS_BLOCK_DATA:
+        case I2C_SMBUS_BLOCK_PROC_CALL:
+            memcpy(buf, data->block, data->block[0] + 1);
+            cnt = data->block[0] + 1;
+            break;
+        case I2C_SMBUS_I2C_BLOCK_DATA:
+            memcpy(buf, &data->block[1], data->block[0]);
+            cnt = data->block[0];
+            break;
+        }
+    }
+    info( "MS prepare to sent [%d bytes]", cnt);
+    for (bid = 0; bid < cnt; bid++) {
+        error = smbus_send_byte(adapter, pci_bar + REG_DR0, buf[bid], &pec);
+        if (error < 0)
+            goto Done;
+    }
+    if (use_pec && !read_back) {
+        error = smbus_send_byte(adapter, pci_bar + REG_DR0, pec, &pec);
+        if (error < 0)
+            goto Done;
+    }
+
+    //REPEATE START
+    if (read_back && size != I2C_SMBUS_QUICK && size != I2C_SMBUS_BYTE) {
+        info( "MS Repeated Start");
+
+        SET_REG_BIT_L(pci_bar + REG_CR0, I2C_CR_BIT_MEN);
+        iowrite8(1 << I2C_CR_BIT_MIEN |
+                 1 << I2C_CR_BIT_MTX |
+                 1 << I2C_CR_BIT_MSTA |
+                 1 << I2C_CR_BIT_RSTA , pci_bar + REG_CR0);
+        SET_REG_BIT_H(pci_bar + REG_CR0, I2C_CR_BIT_MEN);
+
+        // sent Address with Read mode
+        error = smbus_send_byte(adapter, pci_bar + REG_DR0, addr << 1 | 0x1, &pec);
+        if (error < 0) {
+            goto Done;
+        }
+    }
+
+    if (read_back && size != I2C_SMBUS_QUICK) {
+
+        switch (size) {
+        case I2C_SMBUS_BYTE:
+        case I2C_SMBUS_BYTE_DATA:
+            cnt = 1;  break;
+        case I2C_SMBUS_WORD_DATA:
+        case I2C_SMBUS_PROC_CALL:
+            cnt = 2;  break;
+        case I2C_SMBUS_BLOCK_DATA:
+        case I2C_SMBUS_BLOCK_PROC_CALL:
+            // will be changed after received the count
+            cnt = I2C_SMBUS_BLOCK_MAX + 1;  break;
+        case I2C_SMBUS_I2C_BLOCK_DATA:
+            cnt = data->block[0];  break;
+        }
+        if (use_pec)
+            cnt++;
+
+        info( "MS Receive");
+
+        //set to Receive mode
+        iowrite8(1 << I2C_CR_BIT_MEN |
+                 1 << I2C_CR_BIT_MIEN |
+                 1 << I2C_CR_BIT_MSTA , pci_bar + REG_CR0);
+
+        /*
+         * Reading the data register starts the next byte, so TXAK is set
+         * before reading the second to last byte. A block count of 1 only
+         * becomes known while the last byte is already on its way.
+         */
+        for (bid = -1; bid < cnt; bid++) {
+
+            // Wait {A}
+            error = i2c_wait_ack(adapter, 12, 0);
+            if (error < 0) {
+                goto Done;
+            }
+
+            if (bid == cnt - 2) {
+                info( "SET NAK");
+                SET_REG_BIT_H(pci_bar + REG_CR0, I2C_CR_BIT_TXAK);
+            }
+
+            if (bid < 0) {
+                ioread8(pci_bar + REG_DR0);
+                info( "READ Dummy Byte" );
+                continue;
+            }
+
+            if (bid == cnt - 1) {
+                info ( "SET STOP in read loop");
+                SET_REG_BIT_L(pci_bar + REG_CR0, I2C_CR_BIT_MSTA);
+            }
+            buf[bid] = ioread8(pci_bar + REG_DR0);
+            info( "DATA IN [%d] %2.2X", bid, buf[bid]);
+
+            if (block_read && bid == 0) {
+                if (buf[0] < 1 || buf[0] > I2C_SMBUS_BLOCK_MAX) {
+                    error = -EPROTO;
+                    goto Done;
+                }
+                cnt = buf[0] + 1 + use_pec;
+                if (bid == cnt - 2)
+                    SET_REG_BIT_H(pci_bar + REG_CR0, I2C_CR_BIT_TXAK);
+            }
+        }
+
+        if (use_pec) {
+            cnt--;
+            if (smbus_pec(pec, buf, cnt) != buf[cnt]) {
+                error = -EBADMSG;
+                goto Done;
+            }
+        }
+
+        switch (size) {
+        case I2C_SMBUS_BYTE:
+        case I2C_SMBUS_BYTE_DATA:
+            data->byte = buf[0];
+            break;
+        case I2C_SMBUS_WORD_DATA:
+        case I2C_SMBUS_PROC_CALL:
+            data->word = buf[0] | buf[1] << 8;
+            break;
+        case I2C_SMBUS_BLOCK_DATA:
+        case I2C_SMBUS_BLOCK_PROC_CALL:
+            memcpy(data->block, buf, cnt);
+            break;
+        case I2C_SMBUS_I2C_BLOCK_DATA:
+            // block[0] is read length
+            memcpy(&data->block[1], buf, cnt);
+            break;
+        }
+    }
+
+    //[P]
+    SET_REG_BIT_L(pci_bar + REG_CR0, I2C_CR_BIT_MSTA);
+    info( "MS STOP");
+
+Done:
+    iowrite8(1 << I2C_CR_BIT_MEN, pci_bar + REG_CR0);
+    check(pci_bar + REG_CR0);
+    check(pci_bar + REG_SR0);
+#ifdef DEBUG_KERN
+    printk(KERN_INFO "END --- Error code  %d", error);
+#endif
+
+    return error;
+}
+
+/**
+ * Pick the waiter that gets the master next and account the classes it
+ * overtakes. Caller holds the master lock.
+ * @return         the waiter, or NULL if nobody waits
+ */
+static struct i2c_master_waiter *i2c_master_next(struct fpga_i2c_master *master)
+{
+    int next = -1;
+    int p;
+
+    for (p = 0; p < I2C_PRIO_MAX; p++) {
+        if (list_empty(&master->queue[p]))
+            continue;
+        if (next < 0)
+            next = p;
+        if (master->passed[p] >= I2C_ARB_MAX_PASSED) {
+            next = p;
+            break;
+        }
+    }
+    if (next < 0)
+        return NULL;
+
+    for (p = 0; p < I2C_PRIO_MAX; p++) {
+        if (p == next)
+            master->passed[p] = 0;
+        else if (!list_empty(&master->queue[p]))
+            master->passed[p]++;
+    }
+    return list_first_entry(&master->queue[next], struct i2c_master_waiter, list);
+}
+
+/**
+ * Take an I2C master for one transaction. A free master with nobody
+ * queued is taken at once, otherwise the caller queues in its traffic
+ * class and sleeps until the master is handed over to it.
+ * @param  master  the FPGA I2C master
+ * @param  prio    traffic class of the caller
+ */
+static void i2c_master_lock(struct fpga_i2c_master *master, enum i2c_prio prio)
+{
+    struct i2c_master_waiter waiter;
+    int p;
+
+    spin_lock(&master->lock);
+    if (!master->busy) {
+        for (p = 0; p < I2C_PRIO_MAX; p++) {
+            if (!list_empty(&master->queue[p]))
+                break;
+        }
+        if (p == I2C_PRIO_MAX) {
+            master->busy = true;
+            spin_unlock(&master->lock);
+            return;
+        }
+    }
+    waiter.task = current;
+    waiter.granted = false;
+    list_add_tail(&waiter.list, &master->queue[prio]);
+    spin_unlock(&master->lock);
+
+    for (;;) {
+        set_current_state(TASK_UNINTERRUPTIBLE);
+        if (ACCESS_ONCE(waiter.granted))
+            break;
+        schedule();
+    }
+    __set_current_state(TASK_RUNNING);
+}
+
+/* Hand the master to the next waiter, or free it if nobody waits */
+static void i2c_master_unlock(struct fpga_i2c_master *master)
+{
+    struct i2c_master_waiter *waiter;
+    struct task_struct *task;
+
+    spin_lock(&master->lock);
+    waiter = i2c_master_next(master);
+    if (waiter) {
+        /* The waiter may return as soon as granted is set */
+        task = waiter->task;
+        get_task_struct(task);
+        list_del(&waiter->list);
+        smp_wmb();
+        waiter->granted = true;
+        wake_up_process(task);
+        put_task_struct(task);
+    } else {
+        master->busy = false;
+    }
+    spin_unlock(&master->lock);
+}
+
+/**
+ * Wrapper of smbus_access access with PCA9548 I2C switch management.
+ * This function set PCA9548 switches to the proper slave channel.
+ * Only one channel among switches chip is selected during communication time.
+ *
+ * Note: If the bus does not have any PCA9548 on it, the switch_addr must be
+ * set to 0xFF, it will use normal smbus_access function.
+ * Does not wait for port readiness.
+ */
+static int fpga_i2c_xfer(struct i2c_adapter *adapter, u16 addr,
+                         unsigned short flags, char rw, u8 cmd,
+                         int size, union i2c_smbus_data *data)
+{
+    int error = 0;
+    struct i2c_dev_data *dev_data;
+    unsigned char master_bus;
+    unsigned char switch_addr;
+    unsigned char channel;
+    uint16_t prev_port = 0;
+    struct switchboard_fpga_data *fpga_data;
+
+    dev_data = i2c_get_adapdata(adapter);
+    fpga_data = dev_data->fpga_data;
+    master_bus = dev_data->pca9548.master_bus;
+    switch_addr = dev_data->pca9548.switch_addr;
+    channel = dev_data->pca9548.channel;
+
+    // Acquire the master resource.
+    i2c_master_lock(&fpga_data->i2c_master[master_bus - 1], dev_data->prio);
+    prev_port = fpga_data->i2c_master[master_bus - 1].lasted_access_port;
+
+    if (switch_addr != 0xFF) {
+        // Check lasted access switch address on a master
+        if ((unsigned char)(prev_port >> 8) == switch_addr) {
+            // check if channel is the same
+            if ((unsigned char)(prev_port & 0x00FF) != channel) {
+                // set new PCA9548 at switch_addr to current
+                error = smbus_access(adapter, switch_addr, flags, I2C_SMBUS_WRITE, 1 << channel, I2C_SMBUS_BYTE, NULL);
+                // update lasted port
+                fpga_data->i2c_master[master_bus - 1].lasted_access_port = switch_addr << 8 | channel;
+            }
+        } else {
+            // reset prev_port PCA9548 chip
+            error = smbus_access(adapter, (u16)(prev_port >> 8), flags, I2C_SMBUS_WRITE, 0x00, I2C_SMBUS_BYTE, NULL);
+            // set PCA9548 to current channel
+            error = smbus_access(adapter, switch_addr, flags, I2C_SMBUS_WRITE, 1 << channel, I2C_SMBUS_BYTE, NULL);
+            // update lasted port
+            fpga_data->i2c_master[master_bus - 1].lasted_access_port = switch_addr << 8 | channel;
+        }
+    }
+
+    // Do SMBus communication
+    error = smbus_access(adapter, addr, flags, rw, cmd, size, data);
+    // reset the channel
+    i2c_master_unlock(&fpga_data->i2c_master[master_bus - 1]);
+    return error;
+}
+
+/**
+ * The smbus_xfer of the virtual buses. Module accesses on a port bus are
+ * held back while the module is in reset or initializing, so they do not
+ * burn the shared master on NAKs and timeouts.
+ */
+static int fpga_i2c_access(struct i2c_adapter *adapter, u16 addr,
+                           unsigned short flags, char rw, u8 cmd,
+                           int size, union i2c_smbus_data *data)
+{
+    struct i2c_dev_data *dev_data = i2c_get_adapdata(adapter);
+    int error;
+
+    if (dev_data->portid < dev_data->fpga_data->topo->sff_ports) {
+        error = port_ready_gate(dev_data->fpga_data, dev_data->portid);
+        if (error)
+            return error;
+    }
+    return fpga_i2c_xfer(adapter, addr, flags, rw, cmd, size, data);
+}
+
+
+
+/**
+ * A callback function show available smbus functions.
+ */
+static u32 fpga_i2c_func(struct i2c_adapter *a)
+{
+    return I2C_FUNC_SMBUS_QUICK  |
+           I2C_FUNC_SMBUS_BYTE      |
+           I2C_FUNC_SMBUS_BYTE_DATA |
+           I2C_FUNC_SMBUS_WORD_DATA |
+           I2C_FUNC_SMBUS_PROC_CALL |
+           I2C_FUNC_SMBUS_BLOCK_DATA |
+           I2C_FUNC_SMBUS_BLOCK_PROC_CALL |
+           I2C_FUNC_SMBUS_I2C_BLOCK |
+           I2C_FUNC_SMBUS_PEC;
+}
+
+static const struct i2c_algorithm switchboard_i2c_algorithm = {
+    .smbus_xfer = fpga_i2c_access,
+    .functionality  = fpga_i2c_func,
+};
+
+/**
+ * Default traffic class of a bus. Transceiver and fan tray EEPROMs are
+ * bulk, PSU, fan control and thermal devices are latency critical.
+ */
+static enum i2c_prio i2c_bus_default_prio(const struct i2c_switch *bus)
+{
+    static const char *const high_prio_buses[] = {
+        "PSU", "CPLD_fan", "MAX6696", "LM75",
+    };
+    int i;
+
+    if (bus->port_type != NONE || !strncmp(bus->calling_name, "FAN", 3))
+        return I2C_PRIO_BULK;
+    for (i = 0; i < ARRAY_SIZE(high_prio_buses); i++) {
+        if (!strncmp(bus->calling_name, high_prio_buses[i], strlen(high_prio_buses[i])))
+            return I2C_PRIO_HIGH;
+    }
+    return I2C_PRIO_NORMAL;
+}
+
+static ssize_t priority_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct i2c_dev_data *dev_data = i2c_get_adapdata(to_i2c_adapter(dev));
+    return sprintf(buf, "%s\n", i2c_prio_names[ACCESS_ONCE(dev_data->prio)]);
+}
+
+/**
+ * Set the traffic class of a virtual bus.
+ * @param  buf     high, normal or bulk
+ * @return         number of bytes stored, or an error code
+ */
+static ssize_t priority_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct i2c_dev_data *dev_data = i2c_get_adapdata(to_i2c_adapter(dev));
+    int prio;
+
+    for (prio = 0; prio < I2C_PRIO_MAX; prio++) {
+        if (sysfs_streq(buf, i2c_prio_names[prio])) {
+            ACCESS_ONCE(dev_data->prio) = prio;
+            return size;
+        }
+    }
+    return -EINVAL;
+}
+DEVICE_ATTR_RW(priority);
+
+/**
+ * Create virtual I2C bus adapter for switch devices
+ * @param  pdev             platform device pointer
+ * @param  portid           virtual i2c port id for switch device mapping
+ * @param  bus_number_offset bus offset for virtual i2c adapter in system
+ * @return                  i2c adapter.
+ *
+ * When bus_number_offset is -1, created adapter with dynamic bus number.
+ * Otherwise create adapter at i2c bus = bus_number_offset + portid.
+ */
+static struct i2c_adapter * switchboard_i2c_init(struct platform_device *pdev, int portid, int bus_number_offset)
+{
+    int error;
+
+    struct switchboard_fpga_data *fpga_data = platform_get_drvdata(pdev);
+    const struct i2c_switch *bus = &fpga_data->topo->buses[portid];
+    struct i2c_adapter *new_adapter;
+    struct i2c_dev_data *new_data;
+    void __iomem *i2c_freq_base_reg;
+
+    new_adapter = kzalloc(sizeof(*new_adapter), GFP_KERNEL);
+    if (!new_adapter) {
+        printk(KERN_ALERT "Cannot alloc i2c adapter for %s", bus->calling_name);
+        return NULL;
+    }
+
+    new_adapter->owner = THIS_MODULE;
+    new_adapter->class = I2C_CLASS_HWMON | I2C_CLASS_SPD;
+    new_adapter->algo  = &switchboard_i2c_algorithm;
+    /* If the bus offset is -1, use dynamic bus number */
+    if (bus_number_offset == -1) {
+        new_adapter->nr = -1;
+    } else {
+        new_adapter->nr = bus_number_offset + portid;
+    }
+
+    new_data = kzalloc(sizeof(*new_data), GFP_KERNEL);
+    if (!new_data) {
+        printk(KERN_ALERT "Cannot alloc i2c data for %s", bus->calling_name);
+        kzfree(new_adapter);
+        return NULL;
+    }
+
+    new_data->portid = portid;
+    new_data->fpga_data = fpga_data;
+    new_data->pca9548 = *bus;
+    new_data->prio = i2c_bus_default_prio(bus);
+
+    snprintf(new_adapter->name, sizeof(new_adapter->name),
+             "SMBus I2C Adapter PortID: %s", new_data->pca9548.calling_name);
+
+    i2c_freq_base_reg = fpga_data->fpga_dev->data_base_addr + I2C_MASTER_FREQ_1;
+    iowrite8(0x07, i2c_freq_base_reg + (new_data->pca9548.master_bus - 1) * 0x100); // 0x07 400kHz
+    i2c_set_adapdata(new_adapter, new_data);
+    error = i2c_add_numbered_adapter(new_adapter);
+    if (error < 0) {
+        printk(KERN_ALERT "Cannot add i2c adapter %s", new_data->pca9548.calling_name);
+        kzfree(new_adapter);
+        kzfree(new_data);
+        return NULL;
+    }
+    if (device_create_file(&new_adapter->dev, &dev_attr_priority))
+        printk(KERN_WARNING "Cannot create priority of %s", new_data->pca9548.calling_name);
+
+    return new_adapter;
+};
+
+/**
+ * Find a bus of the topology by its calling name.
+ * @return         index of the bus, or -ENODEV
+ */
+static int switchboard_find_bus(const struct fpga_switchboard_topology *topo, const char *name)
+{
+    int portid;
+
+    for (portid = 0; portid < topo->n_buses; portid++) {
+        if (!strcmp(topo->buses[portid].calling_name, name))
+            return portid;
+    }
+    return -ENODEV;
+}
+
+/* PSU telemetry */
+
+/**
+ * Convert a PMBus LINEAR11 value.
+ * @param  raw     5 bit exponent, 11 bit mantissa, both two's complement
+ * @param  scale   unit multiplier, 1000 gives milli units
+ */
+static s64 pmbus_linear11(u16 raw, s64 scale)
+{
+    int exponent = (s16)raw >> 11;
+    s64 val = (s64)(((s16)(raw << 5)) >> 5) * scale;
+
+    return exponent >= 0 ? val << exponent : val >> -exponent;
+}
+
+/**
+ * Read the PMBus telemetry of every PSU into the cache, so hwmon readers
+ * never wait on the PSU bus.
+ */
+static void psu_telemetry_work(struct work_struct *work)
+{
+    struct switchboard_fpga_data *fpga_data =
+        container_of(to_delayed_work(work), struct switchboard_fpga_data, psu_work);
+    struct i2c_adapter *adapter = fpga_data->i2c_adapter[fpga_data->psu_bus];
+    struct psu_telemetry *psu;
+    union i2c_smbus_data data;
+    u16 raw[PSU_SENSOR_MAX];
+    int err[PSU_SENSOR_MAX];
+    int i, sensor;
+
+    for (i = 0; i < PSU_MAX; i++) {
+        psu = &fpga_data->psu[i];
+        for (sensor = 0; sensor < PSU_SENSOR_MAX; sensor++) {
+            err[sensor] = fpga_i2c_access(adapter, psu_pmbus_addr[i], 0, I2C_SMBUS_READ,
+                                          psu_sensors[sensor].reg, I2C_SMBUS_WORD_DATA, &data);
+            raw[sensor] = data.word;
+        }
+        spin_lock(&fpga_data->psu_lock);
+        memcpy(psu->raw, raw, sizeof(raw));
+        memcpy(psu->err, err, sizeof(err));
+        psu->updated = jiffies;
+        spin_unlock(&fpga_data->psu_lock);
+    }
+
+    schedule_delayed_work(&fpga_data->psu_work, msecs_to_jiffies(ACCESS_ONCE(fpga_data->psu_sample_ms)));
+}
+
+static ssize_t psu_sensor_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct psu_telemetry *psu = dev_get_drvdata(dev);
+    struct switchboard_fpga_data *fpga_data = psu->fpga_data;
+    int sensor = to_sensor_dev_attr(attr)->index;
+    u16 raw;
+    int err;
+
+    spin_lock(&fpga_data->psu_lock);
+    raw = psu->raw[sensor];
+    err = psu->updated ? psu->err[sensor] : -EAGAIN;
+    spin_unlock(&fpga_data->psu_lock);
+    if (err)
+        return err;
+    return sprintf(buf, "%lld\n", pmbus_linear11(raw, psu_sensors[sensor].scale));
+}
+
+static ssize_t update_interval_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct psu_telemetry *psu = dev_get_drvdata(dev);
+    return sprintf(buf, "%u\n", psu->fpga_data->psu_sample_ms);
+}
+
+/**
+ * Set the telemetry sampling period, shared by all PSUs.
+ * @param  buf     period in ms
+ * @return         number of bytes stored, or an error code
+ */
+static ssize_t update_interval_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct psu_telemetry *psu = dev_get_drvdata(dev);
+    unsigned int ms;
+    int err;
+
+    err = kstrtouint(buf, 0, &ms);
+    if (err)
+        return err;
+    ms = clamp_val(ms, PSU_SAMPLE_MIN_MS, PSU_SAMPLE_MAX_MS);
+    ACCESS_ONCE(psu->fpga_data->psu_sample_ms) = ms;
+    mod_delayed_work(system_wq, &psu->fpga_data->psu_work, msecs_to_jiffies(ms));
+    return size;
+}
+
+static SENSOR_DEVICE_ATTR(in1_input, S_IRUGO, psu_sensor_show, NULL, PSU_VIN);
+static SENSOR_DEVICE_ATTR(curr1_input, S_IRUGO, psu_sensor_show, NULL, PSU_IOUT);
+static SENSOR_DEVICE_ATTR(power1_input, S_IRUGO, psu_sensor_show, NULL, PSU_POUT);
+static SENSOR_DEVICE_ATTR(temp1_input, S_IRUGO, psu_sensor_show, NULL, PSU_TEMP);
+static DEVICE_ATTR_RW(update_interval);
+
+static struct attribute *psu_telemetry_attrs[] = {
+    &sensor_dev_attr_in1_input.dev_attr.attr,
+    &sensor_dev_attr_curr1_input.dev_attr.attr,
+    &sensor_dev_attr_power1_input.dev_attr.attr,
+    &sensor_dev_attr_temp1_input.dev_attr.attr,
+    &dev_attr_update_interval.attr,
+    NULL,
+};
+ATTRIBUTE_GROUPS(psu_telemetry);
+
+/**
+ * Start the PSU telemetry sampler, when the board has a PSU bus and the
+ * psu_telemetry module parameter is set.
+ * @param  dev     parent of the hwmon devices
+ */
+static void switchboard_psu_init(struct switchboard_fpga_data *fpga_data, struct device *dev)
+{
+    struct psu_telemetry *psu;
+    char name[8];
+    int i;
+
+    fpga_data->psu_bus = switchboard_find_bus(fpga_data->topo, "PSU");
+    if (!psu_telemetry || fpga_data->psu_bus < 0 || !fpga_data->i2c_adapter[fpga_data->psu_bus])
+        return;
+
+    for (i = 0; i < PSU_MAX; i++) {
+        psu = &fpga_data->psu[i];
+        psu->fpga_data = fpga_data;
+        snprintf(name, sizeof(name), "psu%d", i + 1);
+        psu->hwmon = hwmon_device_register_with_groups(dev, name, psu, psu_telemetry_groups);
+        if (IS_ERR(psu->hwmon)) {
+            printk(KERN_WARNING "Cannot register %s telemetry\n", name);
+            psu->hwmon = NULL;
+        }
+    }
+    fpga_data->psu_sample_ms = PSU_SAMPLE_MS;
+    schedule_delayed_work(&fpga_data->psu_work, 0);
+}
+
+static void switchboard_psu_exit(struct switchboard_fpga_data *fpga_data)
+{
+    int i;
+
+    for (i = 0; i < PSU_MAX; i++) {
+        if (fpga_data->psu[i].hwmon)
+            hwmon_device_unregister(fpga_data->psu[i].hwmon);
+    }
+    cancel_delayed_work_sync(&fpga_data->psu_work);
+}
+
+/* SI5344 clock generator register map loader */
+
+static int si5344_write_page(struct switchboard_fpga_data *fpga_data, u8 page)
+{
+    union i2c_smbus_data data;
+
+    data.byte = page;
+    fpga_data->si5344_xfers++;
+    return fpga_i2c_access(fpga_data->i2c_adapter[fpga_data->si5344_bus], SI5344_ADDR, 0,
+                           I2C_SMBUS_WRITE, SI5344_PAGE, I2C_SMBUS_BYTE_DATA, &data);
+}
+
+/**
+ * Write a run of consecutive registers of one page as one transaction,
+ * using the register auto increment of the SI5344.
+ * @param  reg     16 bit address of the first register
+ * @param  buf     register values
+ * @param  len     number of registers, up to I2C_SMBUS_BLOCK_MAX
+ */
+static int si5344_write_burst(struct switchboard_fpga_data *fpga_data, u16 reg,
+                              const u8 *buf, int len)
+{
+    union i2c_smbus_data data;
+    int err;
+
+    if (!len)
+        return 0;
+    if ((reg >> 8) != fpga_data->si5344_page) {
+        err = si5344_write_page(fpga_data, reg >> 8);
+        if (err)
+            return err;
+        fpga_data->si5344_page = reg >> 8;
+    }
+    data.block[0] = len;
+    memcpy(&data.block[1], buf, len);
+    fpga_data->si5344_xfers++;
+    fpga_data->si5344_regs += len;
+    return fpga_i2c_access(fpga_data->i2c_adapter[fpga_data->si5344_bus], SI5344_ADDR, 0,
+                           I2C_SMBUS_WRITE, reg & 0xff,
+                           len == 1 ? I2C_SMBUS_BYTE_DATA : I2C_SMBUS_I2C_BLOCK_DATA, &data);
+}
+
+/**
+ * Program the SI5344 from a ClockBuilder register map. Each line of the
+ * image is '<address>,<value>', other lines are skipped.
+ * @param  fw      register map image
+ * @return         0 when written and locked, or an error code
+ */
+static int si5344_load(struct switchboard_fpga_data *fpga_data, const struct firmware *fw)
+{
+    const char *p = fw->data, *end = fw->data + fw->size, *eol;
+    union i2c_smbus_data data;
+    unsigned int reg, val;
+    u8 burst[I2C_SMBUS_BLOCK_MAX];
+    u16 burst_reg = 0;
+    int burst_len = 0;
+    char line[64];
+    unsigned long timeout;
+    int err = 0;
+
+    fpga_data->si5344_page = -1;
+    for (; p < end; p = eol + 1) {
+        eol = memchr(p, '\n', end - p);
+        if (!eol)
+            eol = end;
+        if (eol - p >= sizeof(line))
+            continue;
+        memcpy(line, p, eol - p);
+        line[eol - p] = '\0';
+        if (sscanf(line, "%x,%x", &reg, &val) != 2)
+            continue;
+        if (reg > 0xffff || val > 0xff) {
+            err = -EINVAL;
+            break;
+        }
+
+        /* Extend the burst while the addresses stay consecutive in one page */
+        if (burst_len && reg == burst_reg + burst_len && (reg >> 8) == (burst_reg >> 8) &&
+                burst_len < I2C_SMBUS_BLOCK_MAX && (reg & 0xff) != SI5344_PAGE &&
+                reg != SI5344_PREAMBLE_REG) {
+            burst[burst_len++] = val;
+            continue;
+        }
+        err = si5344_write_burst(fpga_data, burst_reg, burst, burst_len);
+        if (err)
+            break;
+        burst_reg = reg;
+        burst[0] = val;
+        burst_len = 1;
+
+        if ((reg & 0xff) == SI5344_PAGE) {
+            /* An explicit page write, follow it rather than coalesce */
+            err = si5344_write_page(fpga_data, val);
+            fpga_data->si5344_page = val;
+            burst_len = 0;
+        } else if (reg == SI5344_PREAMBLE_REG && val == SI5344_PREAMBLE_VAL) {
+            /* The preamble must settle before the configuration */
+            err = si5344_write_burst(fpga_data, burst_reg, burst, burst_len);
+            burst_len = 0;
+            msleep(SI5344_PREAMBLE_DELAY_MS);
+        }
+        if (err)
+            break;
+    }
+    if (!err)
+        err = si5344_write_burst(fpga_data, burst_reg, burst, burst_len);
+    if (err)
+        return err;
+
+    /* Wait for calibration and lock */
+    err = si5344_write_page(fpga_data, SI5344_STATUS >> 8);
+    if (err)
+        return err;
+    fpga_data->si5344_page = SI5344_STATUS >> 8;
+    timeout = jiffies + msecs_to_jiffies(SI5344_LOCK_TIMEOUT_MS);
+    do {
+        err = fpga_i2c_access(fpga_data->i2c_adapter[fpga_data->si5344_bus], SI5344_ADDR, 0,
+                              I2C_SMBUS_READ, SI5344_STATUS & 0xff, I2C_SMBUS_BYTE_DATA, &data);
+        if (err)
+            return err;
+        fpga_data->si5344_status = data.byte;
+        if (!(data.byte & SI5344_STATUS_MSK))
+            return 0;
+        msleep(10);
+    } while (time_before(jiffies, timeout));
+    return -ETIMEDOUT;
+}
+
+/**
+ * Load a SI5344 register map.
+ * @param  buf     firmware file name
+ * @return         number of bytes stored, or an error code
+ */
+static ssize_t si5344_load_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    const struct firmware *fw;
+    char name[64];
+    ktime_t start;
+    int err;
+
+    if (size >= sizeof(name))
+        return -EINVAL;
+    strlcpy(name, buf, sizeof(name));
+    strim(name);
+    if (!name[0])
+        return -EINVAL;
+
+    err = request_firmware(&fw, name, dev);
+    if (err)
+        return err;
+
+    mutex_lock(&fpga_data->si5344_lock);
+    fpga_data->si5344_regs = 0;
+    fpga_data->si5344_xfers = 0;
+    fpga_data->si5344_status = 0;
+    start = ktime_get();
+    err = si5344_load(fpga_data, fw);
+    fpga_data->si5344_load_us = ktime_us_delta(ktime_get(), start);
+    fpga_data->si5344_result = err;
+    printk(KERN_INFO "SI5344 %s: %d, %u registers in %u transactions, %lld us\n",
+           name, err, fpga_data->si5344_regs, fpga_data->si5344_xfers,
+           fpga_data->si5344_load_us);
+    mutex_unlock(&fpga_data->si5344_lock);
+
+    release_firmware(fw);
+    return err ? err : size;
+}
+static DEVICE_ATTR(load, 0200, NULL, si5344_load_store);
+
+/**
+ * Show the result of the last register map load.
+ * @param  buf  '<result> <registers> <transactions> <load time us> <status register>'
+ * @return      number of bytes read, or an error code
+ */
+static ssize_t si5344_status_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    ssize_t len;
+
+    mutex_lock(&fpga_data->si5344_lock);
+    len = sprintf(buf, "%d %u %u %lld 0x%2.2x\n", fpga_data->si5344_result,
+                  fpga_data->si5344_regs, fpga_data->si5344_xfers,
+                  fpga_data->si5344_load_us, fpga_data->si5344_status);
+    mutex_unlock(&fpga_data->si5344_lock);
+    return len;
+}
+static DEVICE_ATTR(status, 0444, si5344_status_show, NULL);
+
+static struct attribute *si5344_attrs[] = {
+    &dev_attr_load.attr,
+    &dev_attr_status.attr,
+    NULL,
+};
+
+static struct attribute_group si5344_attr_grp = {
+    .name = "SI5344",
+    .attrs = si5344_attrs,
+};
+
+/* UCD90120 rail sampler */
+
+/* Any rail with a trigger threshold, sampling only runs while one is set */
+static bool ucd_armed(struct switchboard_fpga_data *fpga_data)
+{
+    int rail;
+
+    for (rail = 0; rail < UCD90120_RAILS; rail++) {
+        if (ACCESS_ONCE(fpga_data->ucd_threshold_mv[rail]))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Read the output voltage of every rail. The I2C master is held across the
+ * whole sweep, so no other user of the UCD90120 can move PAGE between a
+ * page select and its READ_VOUT. The PAGE found on entry is restored, as
+ * the pmbus drivers cache it. The UCD90120 bus has no PCA9548.
+ * @param  mv      voltage of each rail in mV
+ */
+static int ucd_read_rails(struct switchboard_fpga_data *fpga_data, u16 *mv)
+{
+    struct i2c_adapter *adapter = fpga_data->i2c_adapter[fpga_data->ucd_bus];
+    struct i2c_dev_data *dev_data = i2c_get_adapdata(adapter);
+    struct fpga_i2c_master *master = &fpga_data->i2c_master[dev_data->pca9548.master_bus - 1];
+    union i2c_smbus_data data;
+    u8 page;
+    s64 val;
+    int rail, err;
+
+    i2c_master_lock(master, dev_data->prio);
+    err = smbus_access(adapter, UCD90120_ADDR, 0, I2C_SMBUS_READ,
+                       PMBUS_PAGE, I2C_SMBUS_BYTE_DATA, &data);
+    if (err)
+        goto unlock;
+    page = data.byte;
+
+    for (rail = 0; rail < UCD90120_RAILS; rail++) {
+        data.byte = rail;
+        err = smbus_access(adapter, UCD90120_ADDR, 0, I2C_SMBUS_WRITE,
+                           PMBUS_PAGE, I2C_SMBUS_BYTE_DATA, &data);
+        if (err)
+            goto restore;
+        if (!fpga_data->ucd_exp_valid) {
+            err = smbus_access(adapter, UCD90120_ADDR, 0, I2C_SMBUS_READ,
+                               PMBUS_VOUT_MODE, I2C_SMBUS_BYTE_DATA, &data);
+            if (err)
+                goto restore;
+            /* LINEAR16 exponent, 5 bit two's complement */
+            fpga_data->ucd_exp[rail] = sign_extend32(data.byte, 4);
+        }
+        err = smbus_access(adapter, UCD90120_ADDR, 0, I2C_SMBUS_READ,
+                           PMBUS_READ_VOUT, I2C_SMBUS_WORD_DATA, &data);
+        if (err)
+            goto restore;
+        val = (s64)data.word * 1000;
+        val = fpga_data->ucd_exp[rail] >= 0 ? val << fpga_data->ucd_exp[rail] :
+              val >> -fpga_data->ucd_exp[rail];
+        mv[rail] = min_t(s64, val, U16_MAX);
+    }
+    fpga_data->ucd_exp_valid = true;
+
+restore:
+    data.byte = page;
+    if (smbus_access(adapter, UCD90120_ADDR, 0, I2C_SMBUS_WRITE,
+                     PMBUS_PAGE, I2C_SMBUS_BYTE_DATA, &data) && !err)
+        err = -EIO;
+unlock:
+    i2c_master_unlock(master);
+    return err;
+}
+
+/**
+ * Add one sample to the ring. A rail below its threshold triggers the
+ * capture, which freezes once the post-trigger samples are in.
+ * @return         true when the capture just froze
+ */
+static bool ucd_record(struct switchboard_fpga_data *fpga_data, const u16 *mv, ktime_t ts)
+{
+    struct ucd_sample *sample;
+    bool frozen = false;
+    int rail;
+
+    spin_lock(&fpga_data->ucd_lock);
+    if (fpga_data->ucd_state == UCD_FROZEN) {
+        spin_unlock(&fpga_data->ucd_lock);
+        return false;
+    }
+    sample = &fpga_data->ucd_ring[fpga_data->ucd_head];
+    sample->ts = ktime_to_ns(ts);
+    memcpy(sample->rail_mv, mv, sizeof(sample->rail_mv));
+    sample->flags = 0;
+    fpga_data->ucd_head = (fpga_data->ucd_head + 1) % UCD_CAPTURE_LEN;
+
+    if (fpga_data->ucd_state == UCD_ARMED) {
+        for (rail = 0; rail < UCD90120_RAILS; rail++) {
+            if (mv[rail] < fpga_data->ucd_threshold_mv[rail]) {
+                sample->flags |= UCD_SAMPLE_TRIGGER;
+                fpga_data->ucd_state = UCD_TRIGGERED;
+                fpga_data->ucd_trigger_rail = rail;
+                fpga_data->ucd_trigger_ts = ts;
+                fpga_data->ucd_post_left = fpga_data->ucd_post_trigger;
+                break;
+            }
+        }
+    } else if (fpga_data->ucd_post_left) {
+        fpga_data->ucd_post_left--;
+    }
+    if (fpga_data->ucd_state == UCD_TRIGGERED && !fpga_data->ucd_post_left) {
+        fpga_data->ucd_state = UCD_FROZEN;
+        frozen = true;
+    }
+    spin_unlock(&fpga_data->ucd_lock);
+    return frozen;
+}
+
+static int ucd_sampler_thread(void *arg)
+{
+    struct switchboard_fpga_data *fpga_data = arg;
+    u16 mv[UCD90120_RAILS];
+    ktime_t next = ktime_get();
+    unsigned int period_us;
+    s64 left_us;
+
+    while (!kthread_should_stop()) {
+        period_us = ACCESS_ONCE(fpga_data->ucd_sample_us);
+        if (!period_us || ACCESS_ONCE(fpga_data->ucd_state) == UCD_FROZEN ||
+                !ucd_armed(fpga_data)) {
+            wait_event_interruptible(fpga_data->ucd_wait, kthread_should_stop() ||
+                                     (ACCESS_ONCE(fpga_data->ucd_sample_us) &&
+                                      ACCESS_ONCE(fpga_data->ucd_state) != UCD_FROZEN &&
+                                      ucd_armed(fpga_data)));
+            next = ktime_get();
+            continue;
+        }
+
+        if (ucd_read_rails(fpga_data, mv)) {
+            fpga_data->ucd_errors++;
+        } else {
+            fpga_data->ucd_samples++;
+            if (ucd_record(fpga_data, mv, ktime_get())) {
+                printk(KERN_WARNING "UCD90120 rail %d below %u mV, capture frozen\n",
+                       fpga_data->ucd_trigger_rail + 1,
+                       fpga_data->ucd_threshold_mv[fpga_data->ucd_trigger_rail]);
+                sysfs_notify(&fpga_data->fpga_dev->pdev->dev.kobj, "UCD90120", "state");
+            }
+        }
+
+        /* Keep a fixed rate, a late sample does not shift the following ones */
+        next = ktime_add_us(next, period_us);
+        left_us = ktime_us_delta(next, ktime_get());
+        if (left_us > 0)
+            usleep_range(left_us, left_us + left_us / 8 + 1);
+        else
+            next = ktime_get();
+    }
+    return 0;
+}
+
+static ssize_t sample_us_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    return sprintf(buf, "%u\n", fpga_data->ucd_sample_us);
+}
+
+/**
+ * Set the rail sampling period.
+ * @param  buf     period in us, 0 stops sampling
+ * @return         number of bytes stored, or an error code
+ */
+static ssize_t sample_us_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    unsigned int us;
+    int err;
+
+    err = kstrtouint(buf, 0, &us);
+    if (err)
+        return err;
+    if (us && (us < UCD_SAMPLE_MIN_US || us > UCD_SAMPLE_MAX_US))
+        return -EINVAL;
+    ACCESS_ONCE(fpga_data->ucd_sample_us) = us;
+    wake_up_interruptible(&fpga_data->ucd_wait);
+    return size;
+}
+static DEVICE_ATTR_RW(sample_us);
+
+static ssize_t thresholds_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    ssize_t len = 0;
+    int rail;
+
+    for (rail = 0; rail < UCD90120_RAILS; rail++)
+        len += sprintf(buf + len, "%u%c", fpga_data->ucd_threshold_mv[rail],
+                       rail == UCD90120_RAILS - 1 ? '\n' : ' ');
+    return len;
+}
+
+/**
+ * Set the trigger threshold of a rail. Rails are only sampled while at
+ * least one threshold is set.
+ * @param  buf     '<rail 1..12> <mV>', 0 mV disables the rail trigger
+ * @return         number of bytes stored, or an error code
+ */
+static ssize_t thresholds_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    unsigned int rail, mv;
+
+    if (sscanf(buf, "%u %u", &rail, &mv) != 2)
+        return -EINVAL;
+    if (rail < 1 || rail > UCD90120_RAILS || mv > U16_MAX)
+        return -EINVAL;
+    spin_lock(&fpga_data->ucd_lock);
+    fpga_data->ucd_threshold_mv[rail - 1] = mv;
+    spin_unlock(&fpga_data->ucd_lock);
+    /* The first threshold starts the sampler */
+    wake_up_interruptible(&fpga_data->ucd_wait);
+    return size;
+}
+static DEVICE_ATTR_RW(thresholds);
+
+static ssize_t post_trigger_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    return sprintf(buf, "%u\n", fpga_data->ucd_post_trigger);
+}
+
+/**
+ * Set how many samples are kept after the trigger, the rest of the
+ * capture is pre-trigger history.
+ * @param  buf     number of samples, below the capture length
+ * @return         number of bytes stored, or an error code
+ */
+static ssize_t post_trigger_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    unsigned int samples;
+    int err;
+
+    err = kstrtouint(buf, 0, &samples);
+    if (err)
+        return err;
+    if (samples >= UCD_CAPTURE_LEN)
+        return -EINVAL;
+    spin_lock(&fpga_data->ucd_lock);
+    fpga_data->ucd_post_trigger = samples;
+    spin_unlock(&fpga_data->ucd_lock);
+    return size;
+}
+static DEVICE_ATTR_RW(post_trigger);
+
+/**
+ * Show the capture state. Pollable, notified when the capture freezes.
+ * @param  buf  'armed', 'triggered' or 'frozen', then the trigger rail and
+ *              time in ns, the sample count and the read error count
+ * @return      number of bytes read, or an error code
+ */
+static ssize_t ucd_state_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    static const char *const names[] = { "armed", "triggered", "frozen" };
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    enum ucd_state state;
+    int rail;
+    s64 ts;
+
+    spin_lock(&fpga_data->ucd_lock);
+    state = fpga_data->ucd_state;
+    rail = fpga_data->ucd_trigger_rail + 1;
+    ts = ktime_to_ns(fpga_data->ucd_trigger_ts);
+    spin_unlock(&fpga_data->ucd_lock);
+    if (state == UCD_ARMED)
+        rail = ts = 0;
+    return sprintf(buf, "%s %d %lld %lu %lu\n", names[state], rail, ts,
+                   fpga_data->ucd_samples, fpga_data->ucd_errors);
+}
+
+/**
+ * Re-arm the capture trigger.
+ * @param  buf     'arm'
+ * @return         number of bytes stored, or an error code
+ */
+static ssize_t ucd_state_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+
+    if (!sysfs_streq(buf, "arm"))
+        return -EINVAL;
+    spin_lock(&fpga_data->ucd_lock);
+    fpga_data->ucd_state = UCD_ARMED;
+    spin_unlock(&fpga_data->ucd_lock);
+    wake_up_interruptible(&fpga_data->ucd_wait);
+    return size;
+}
+static struct device_attribute dev_attr_ucd_state = __ATTR(state, 0644, ucd_state_show, ucd_state_store);
+
+/**
+ * Read the capture window, oldest sample first. The content is stable
+ * once the capture is frozen.
+ */
+static ssize_t capture_read(struct file *filp, struct kobject *kobj,
+                            struct bin_attribute *attr, char *buf,
+                            loff_t off, size_t count)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(kobj_to_dev(kobj));
+    struct ucd_sample *snap;
+    unsigned int head;
+
+    if (off >= UCD_CAPTURE_SIZE)
+        return 0;
+    count = min_t(size_t, count, UCD_CAPTURE_SIZE - off);
+
+    snap = vmalloc(UCD_CAPTURE_SIZE);
+    if (!snap)
+        return -ENOMEM;
+    spin_lock(&fpga_data->ucd_lock);
+    head = fpga_data->ucd_head;
+    memcpy(snap, &fpga_data->ucd_ring[head], (UCD_CAPTURE_LEN - head) * sizeof(*snap));
+    memcpy(&snap[UCD_CAPTURE_LEN - head], fpga_data->ucd_ring, head * sizeof(*snap));
+    spin_unlock(&fpga_data->ucd_lock);
+
+    memcpy(buf, (char *)snap + off, count);
+    vfree(snap);
+    return count;
+}
+static BIN_ATTR_RO(capture, UCD_CAPTURE_SIZE);
+
+static struct attribute *ucd_attrs[] = {
+    &dev_attr_sample_us.attr,
+    &dev_attr_thresholds.attr,
+    &dev_attr_post_trigger.attr,
+    &dev_attr_ucd_state.attr,
+    NULL,
+};
+
+static struct bin_attribute *ucd_bin_attrs[] = {
+    &bin_attr_capture,
+    NULL,
+};
+
+static struct attribute_group ucd_attr_grp = {
+    .name = "UCD90120",
+    .attrs = ucd_attrs,
+    .bin_attrs = ucd_bin_attrs,
+};
+
+/**
+ * Start the rail sampler, when the board has a UCD90120 bus.
+ * @param  pdev    switchboard platform device
+ */
+static void switchboard_ucd_init(struct platform_device *pdev)
+{
+    struct switchboard_fpga_data *fpga_data = platform_get_drvdata(pdev);
+
+    fpga_data->ucd_bus = switchboard_find_bus(fpga_data->topo, "UCD90120");
+    if (fpga_data->ucd_bus < 0 || !fpga_data->i2c_adapter[fpga_data->ucd_bus])
+        goto none;
+
+    fpga_data->ucd_ring = devm_kcalloc(&pdev->dev, UCD_CAPTURE_LEN,
+                                       sizeof(*fpga_data->ucd_ring), GFP_KERNEL);
+    if (!fpga_data->ucd_ring)
+        goto none;
+    fpga_data->ucd_sample_us = UCD_SAMPLE_US;
+    fpga_data->ucd_post_trigger = UCD_CAPTURE_LEN / 2;
+    if (sysfs_create_group(&pdev->dev.kobj, &ucd_attr_grp))
+        goto none;
+    fpga_data->ucd_thread = kthread_run(ucd_sampler_thread, fpga_data, "ucd90120/%d",
+                                        fpga_data->fpga_dev->instance);
+    if (IS_ERR(fpga_data->ucd_thread)) {
+        sysfs_remove_group(&pdev->dev.kobj, &ucd_attr_grp);
+        goto none;
+    }
+    return;
+
+none:
+    fpga_data->ucd_thread = NULL;
+    fpga_data->ucd_bus = -ENODEV;
+}
+
+static void switchboard_ucd_exit(struct platform_device *pdev)
+{
+    struct switchboard_fpga_data *fpga_data = platform_get_drvdata(pdev);
+
+    if (!fpga_data->ucd_thread)
+        return;
+    sysfs_remove_group(&pdev->dev.kobj, &ucd_attr_grp);
+    kthread_stop(fpga_data->ucd_thread);
+}
+
+/* Board sensor hub */
+
+static const char *const hub_size_names[] = {
+    [HUB_BYTE] = "byte",
+    [HUB_WORD] = "word",
+    [HUB_WORD_SWAPPED] = "word_swapped",
+};
+
+/* Board sensors sampled unless reconfigured through channels */
+static const struct {
+    const char *bus;
+    u8 addr;
+    u8 reg;
+    enum hub_size size;
+} hub_default_channels[] = {
+    { "LM75", 0x48, 0x00, HUB_WORD_SWAPPED },       // Temperature
+    { "MAX6696", 0x18, 0x00, HUB_BYTE },            // Local temperature
+    { "MAX6696", 0x18, 0x01, HUB_BYTE },            // Remote temperature
+};
+
+/**
+ * Read the hub channels on one master. The masters of a board are
+ * independent, so one of these runs per master concurrently.
+ */
+static void hub_master_work(struct work_struct *work)
+{
+    struct hub_master *hm = container_of(work, struct hub_master, work);
+    struct switchboard_fpga_data *fpga_data = hm->fpga_data;
+    struct hub_channel *ch;
+    union i2c_smbus_data data;
+    int i, err;
+
+    for (i = 0; i < fpga_data->hub_n_channels; i++) {
+        ch = &fpga_data->hub_channels[i];
+        if (fpga_data->topo->buses[ch->bus].master_bus != hm->master_bus)
+            continue;
+        err = fpga_i2c_access(fpga_data->i2c_adapter[ch->bus], ch->addr, 0, I2C_SMBUS_READ,
+                              ch->reg, ch->size == HUB_BYTE ? I2C_SMBUS_BYTE_DATA :
+                              I2C_SMBUS_WORD_DATA, &data);
+        if (err)
+            fpga_data->hub_stage[i].value = err;
+        else if (ch->size == HUB_BYTE)
+            fpga_data->hub_stage[i].value = data.byte;
+        else if (ch->size == HUB_WORD)
+            fpga_data->hub_stage[i].value = data.word;
+        else
+            fpga_data->hub_stage[i].value = swab16(data.word);
+    }
+}
+
+/**
+ * Refresh every hub channel, one reader per master, and publish the
+ * results as one snapshot.
+ */
+static void hub_refresh_work(struct work_struct *work)
+{
+    struct switchboard_fpga_data *fpga_data =
+        container_of(to_delayed_work(work), struct switchboard_fpga_data, hub_work);
+    struct hub_channel *ch;
+    unsigned long used = 0;
+    int i;
+
+    mutex_lock(&fpga_data->hub_lock);
+    for (i = 0; i < fpga_data->hub_n_channels; i++) {
+        ch = &fpga_data->hub_channels[i];
+        fpga_data->hub_stage[i].bus = ch->bus;
+        fpga_data->hub_stage[i].addr = ch->addr;
+        fpga_data->hub_stage[i].reg = ch->reg;
+        __set_bit(fpga_data->topo->buses[ch->bus].master_bus - 1, &used);
+    }
+    for_each_set_bit(i, &used, FPGA_I2C_MASTER_MAX)
+        queue_work(system_unbound_wq, &fpga_data->hub_master[i].work);
+    for_each_set_bit(i, &used, FPGA_I2C_MASTER_MAX)
+        flush_work(&fpga_data->hub_master[i].work);
+
+    spin_lock(&fpga_data->hub_snap_lock);
+    fpga_data->hub_snap.ts = ktime_to_ns(ktime_get());
+    fpga_data->hub_snap.seq++;
+    fpga_data->hub_snap.count = fpga_data->hub_n_channels;
+    memcpy(fpga_data->hub_snap.reading, fpga_data->hub_stage,
+           fpga_data->hub_n_channels * sizeof(fpga_data->hub_stage[0]));
+    memset(&fpga_data->hub_snap.reading[fpga_data->hub_n_channels], 0,
+           (HUB_CHANNEL_MAX - fpga_data->hub_n_channels) * sizeof(fpga_data->hub_stage[0]));
+    spin_unlock(&fpga_data->hub_snap_lock);
+    mutex_unlock(&fpga_data->hub_lock);
+
+    sysfs_notify(&fpga_data->fpga_dev->pdev->dev.kobj, "sensor_hub", "snapshot");
+    if (ACCESS_ONCE(fpga_data->hub_interval_ms))
+        schedule_delayed_work(&fpga_data->hub_work,
+                              msecs_to_jiffies(ACCESS_ONCE(fpga_data->hub_interval_ms)));
+}
+
+/**
+ * Add a channel to the hub.
+ * @param  bus     bus index in the topology
+ * @return         0 on success, or an error code
+ */
+static int hub_add_channel(struct switchboard_fpga_data *fpga_data, int bus, u8 addr, u8 reg,
+                           enum hub_size size)
+{
+    struct hub_channel *ch;
+
+    if (bus < 0 || !fpga_data->i2c_adapter[bus])
+        return -ENODEV;
+    if (fpga_data->hub_n_channels >= HUB_CHANNEL_MAX)
+        return -ENOSPC;
+    ch = &fpga_data->hub_channels[fpga_data->hub_n_channels++];
+    ch->bus = bus;
+    ch->addr = addr;
+    ch->reg = reg;
+    ch->size = size;
+    return 0;
+}
+
+static ssize_t channels_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    struct hub_channel *ch;
+    ssize_t len = 0;
+    int i;
+
+    mutex_lock(&fpga_data->hub_lock);
+    for (i = 0; i < fpga_data->hub_n_channels; i++) {
+        ch = &fpga_data->hub_channels[i];
+        len += scnprintf(buf + len, PAGE_SIZE - len, "%s 0x%2.2x 0x%2.2x %s\n",
+                         fpga_data->topo->buses[ch->bus].calling_name, ch->addr,
+                         ch->reg, hub_size_names[ch->size]);
+    }
+    mutex_unlock(&fpga_data->hub_lock);
+    return len;
+}
+
+/**
+ * Change the hub channels. Snapshot readings follow the channel order.
+ * @param  buf     'add <bus name> <addr> <reg> <byte|word|word_swapped>' or 'clear'
+ * @return         number of bytes stored, or an error code
+ */
+static ssize_t channels_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    char bus[20], width[16];
+    unsigned int addr, reg;
+    int i, err = -EINVAL;
+
+    if (sysfs_streq(buf, "clear")) {
+        mutex_lock(&fpga_data->hub_lock);
+        fpga_data->hub_n_channels = 0;
+        mutex_unlock(&fpga_data->hub_lock);
+        return size;
+    }
+    if (sscanf(buf, "add %19s %x %x %15s", bus, &addr, &reg, width) != 4 ||
+            addr > 0x7f || reg > 0xff)
+        return -EINVAL;
+
+    mutex_lock(&fpga_data->hub_lock);
+    for (i = 0; i < ARRAY_SIZE(hub_size_names); i++) {
+        if (!strcmp(width, hub_size_names[i])) {
+            err = hub_add_channel(fpga_data, switchboard_find_bus(fpga_data->topo, bus),
+                                  addr, reg, i);
+            break;
+        }
+    }
+    mutex_unlock(&fpga_data->hub_lock);
+    return err ? err : size;
+}
+static DEVICE_ATTR_RW(channels);
+
+static ssize_t interval_ms_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    return sprintf(buf, "%u\n", fpga_data->hub_interval_ms);
+}
+
+/**
+ * Set the hub refresh period.
+ * @param  buf     period in ms, 0 stops refreshing
+ * @return         number of bytes stored, or an error code
+ */
+static ssize_t interval_ms_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t size)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(dev);
+    unsigned int ms;
+    int err;
+
+    err = kstrtouint(buf, 0, &ms);
+    if (err)
+        return err;
+    if (ms && (ms < HUB_INTERVAL_MIN_MS || ms > HUB_INTERVAL_MAX_MS))
+        return -EINVAL;
+    ACCESS_ONCE(fpga_data->hub_interval_ms) = ms;
+    if (ms)
+        mod_delayed_work(system_wq, &fpga_data->hub_work, msecs_to_jiffies(ms));
+    return size;
+}
+static DEVICE_ATTR_RW(interval_ms);
+
+/**
+ * Read the last snapshot, a struct hub_snapshot. Pollable, notified on
+ * each refresh.
+ */
+static ssize_t snapshot_read(struct file *filp, struct kobject *kobj,
+                             struct bin_attribute *attr, char *buf,
+                             loff_t off, size_t count)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(kobj_to_dev(kobj));
+
+    if (off >= sizeof(struct hub_snapshot))
+        return 0;
+    count = min_t(size_t, count, sizeof(struct hub_snapshot) - off);
+
+    spin_lock(&fpga_data->hub_snap_lock);
+    memcpy(buf, (char *)&fpga_data->hub_snap + off, count);
+    spin_unlock(&fpga_data->hub_snap_lock);
+    return count;
+}
+static BIN_ATTR_RO(snapshot, sizeof(struct hub_snapshot));
+
+static struct attribute *hub_attrs[] = {
+    &dev_attr_channels.attr,
+    &dev_attr_interval_ms.attr,
+    NULL,
+};
+
+static struct bin_attribute *hub_bin_attrs[] = {
+    &bin_attr_snapshot,
+    NULL,
+};
+
+static struct attribute_group hub_attr_grp = {
+    .name = "sensor_hub",
+    .attrs = hub_attrs,
+    .bin_attrs = hub_bin_attrs,
+};
+
+/**
+ * Start the sensor hub with the default board sensors found in the
+ * topology.
+ * @param  pdev    switchboard platform device
+ */
+static void switchboard_hub_init(struct platform_device *pdev)
+{
+    struct switchboard_fpga_data *fpga_data = platform_get_drvdata(pdev);
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(hub_default_channels); i++)
+        hub_add_channel(fpga_data, switchboard_find_bus(fpga_data->topo, hub_default_channels[i].bus),
+                        hub_default_channels[i].addr, hub_default_channels[i].reg,
+                        hub_default_channels[i].size);
+    if (sysfs_create_group(&pdev->dev.kobj, &hub_attr_grp)) {
+        printk(KERN_WARNING "Cannot create sensor hub attributes\n");
+        return;
+    }
+    fpga_data->hub_active = true;
+    fpga_data->hub_interval_ms = HUB_INTERVAL_MS;
+    schedule_delayed_work(&fpga_data->hub_work, 0);
+}
+
+static void switchboard_hub_exit(struct platform_device *pdev)
+{
+    struct switchboard_fpga_data *fpga_data = platform_get_drvdata(pdev);
+
+    if (!fpga_data->hub_active)
+        return;
+    sysfs_remove_group(&pdev->dev.kobj, &hub_attr_grp);
+    fpga_data->hub_interval_ms = 0;
+    cancel_delayed_work_sync(&fpga_data->hub_work);
+}
+
+/* Fan tray FRU EEPROM cache */
+
+/**
+ * Read a whole fan tray FRU EEPROM into its cache.
+ * @return         0 on success, or an error code
+ */
+static int fan_fru_fill(struct switchboard_fpga_data *fpga_data, struct fan_fru *fru)
+{
+    union i2c_smbus_data data;
+    int off, err;
+
+    for (off = 0; off < FAN_FRU_SIZE; off += I2C_SMBUS_BLOCK_MAX) {
+        data.block[0] = I2C_SMBUS_BLOCK_MAX;
+        err = fpga_i2c_access(fpga_data->i2c_adapter[fru->bus], FAN_FRU_ADDR, 0, I2C_SMBUS_READ,
+                              off, I2C_SMBUS_I2C_BLOCK_DATA, &data);
+        if (err)
+            return err;
+        memcpy(&fru->data[off], &data.block[1], I2C_SMBUS_BLOCK_MAX);
+    }
+    return 0;
+}
+
+/**
+ * Follow the fan tray presence reported by the fan CPLD. A tray change
+ * drops its cached FRU, an inserted tray is read once and then served
+ * from the cache.
+ */
+static void fan_fru_work(struct work_struct *work)
+{
+    struct switchboard_fpga_data *fpga_data =
+        container_of(to_delayed_work(work), struct switchboard_fpga_data, fan_fru_work);
+    struct fan_fru *fru;
+    union i2c_smbus_data data;
+    bool present;
+    int i, err;
+
+    err = fpga_i2c_access(fpga_data->i2c_adapter[fpga_data->fan_cpld_bus], FAN_CPLD_ADDR, 0,
+                          I2C_SMBUS_READ, FAN_CPLD_PRESENCE, I2C_SMBUS_BYTE_DATA, &data);
+    if (err)
+        goto out;
+
+    for (i = 0; i < fpga_data->n_fans; i++) {
+        fru = &fpga_data->fan_fru[i];
+        /* Assumed: presence is active low, bit i is FAN(i+1) */
+        present = !(data.byte & BIT(i));
+        if (present == fru->present && (!present || fru->valid))
+            continue;
+
+        mutex_lock(&fpga_data->fan_fru_lock);
+        fru->valid = false;
+        fru->present = present;
+        mutex_unlock(&fpga_data->fan_fru_lock);
+
+        if (present && fan_fru_fill(fpga_data, fru))
+            continue;   // Retried on the next poll
+
+        mutex_lock(&fpga_data->fan_fru_lock);
+        fru->valid = present;
+        mutex_unlock(&fpga_data->fan_fru_lock);
+        sysfs_notify(&fpga_data->fpga_dev->pdev->dev.kobj, "fan_fru", fru->attr.attr.name);
+    }
+
+out:
+    schedule_delayed_work(&fpga_data->fan_fru_work, msecs_to_jiffies(FAN_PRESENCE_POLL_MS));
+}
+
+/**
+ * Read the cached FRU EEPROM of a fan tray. Pollable, notified when the
+ * tray is removed or its FRU has been cached.
+ * @return         bytes read, -ENODEV without a tray, or -EAGAIN while the
+ *                 FRU is not cached yet
+ */
+static ssize_t fan_fru_read(struct file *filp, struct kobject *kobj,
+                            struct bin_attribute *attr, char *buf,
+                            loff_t off, size_t count)
+{
+    struct switchboard_fpga_data *fpga_data = dev_get_drvdata(kobj_to_dev(kobj));
+    struct fan_fru *fru = attr->private;
+    ssize_t ret;
+
+    if (off >= FAN_FRU_SIZE)
+        return 0;
+    count = min_t(size_t, count, FAN_FRU_SIZE - off);
+
+    mutex_lock(&fpga_data->fan_fru_lock);
+    if (!fru->present) {
+        ret = -ENODEV;
+    } else if (!fru->valid) {
+        ret = -EAGAIN;
+    } else {
+        memcpy(buf, &fru->data[off], count);
+        ret = count;
+    }
+    mutex_unlock(&fpga_data->fan_fru_lock);
+    return ret;
+}
+
+/**
+ * Cache the FRU of the fan trays found in the topology, one binary
+ * attribute per tray under fan_fru.
+ * @param  pdev    switchboard platform device
+ */
+static void switchboard_fan_fru_init(struct platform_device *pdev)
+{
+    struct switchboard_fpga_data *fpga_data = platform_get_drvdata(pdev);
+    struct fan_fru *fru;
+    char name[8];
+    int i, bus;
+
+    fpga_data->fan_cpld_bus = switchboard_find_bus(fpga_data->topo, "CPLD_fan");
+    if (!fan_fru || fpga_data->fan_cpld_bus < 0 || !fpga_data->i2c_adapter[fpga_data->fan_cpld_bus])
+        return;
+
+    for (i = 0; i < FAN_TRAY_MAX; i++) {
+        snprintf(name, sizeof(name), "FAN%d", i + 1);
+        bus = switchboard_find_bus(fpga_data->topo, name);
+        if (bus < 0 || !fpga_data->i2c_adapter[bus])
+            break;
+        fru = &fpga_data->fan_fru[i];
+        fru->data = devm_kzalloc(&pdev->dev, FAN_FRU_SIZE, GFP_KERNEL);
+        if (!fru->data)
+            break;
+        fru->bus = bus;
+        sysfs_bin_attr_init(&fru->attr);
+        fru->attr.attr.name = fpga_data->topo->buses[bus].calling_name;
+        fru->attr.attr.mode = 0444;
+        fru->attr.size = FAN_FRU_SIZE;
+        fru->attr.read = fan_fru_read;
+        fru->attr.private = fru;
+        fpga_data->fan_fru_bin_attrs[i] = &fru->attr;
+    }
+    fpga_data->n_fans = i;
+    if (!fpga_data->n_fans)
+        return;
+
+    fpga_data->fan_fru_grp.name = "fan_fru";
+    fpga_data->fan_fru_grp.bin_attrs = fpga_data->fan_fru_bin_attrs;
+    if (sysfs_create_group(&pdev->dev.kobj, &fpga_data->fan_fru_grp)) {
+        printk(KERN_WARNING "Cannot create fan FRU attributes\n");
+        fpga_data->n_fans = 0;
+        return;
+    }
+    schedule_delayed_work(&fpga_data->fan_fru_work, 0);
+}
+
+static void switchboard_fan_fru_exit(struct platform_device *pdev)
+{
+    struct switchboard_fpga_data *fpga_data = platform_get_drvdata(pdev);
+
+    if (!fpga_data->n_fans)
+        return;
+    sysfs_remove_group(&pdev->dev.kobj, &fpga_data->fan_fru_grp);
+    cancel_delayed_work_sync(&fpga_data->fan_fru_work);
+}
+
+/**
+ * Board info for QSFP/SFP+ eeprom.
+ * Note: Using OOM optoe as I2C eeprom driver.
+ * https://www.opencompute.org/wiki/Networking/SpecsAndDesigns#Open_Optical_Monitoring
+ */
+static struct i2c_board_info sff8436_eeprom_info[] = {
+    { I2C_BOARD_INFO("optoe1", 0x50) }, //For QSFP w/ sff8436
+    { I2C_BOARD_INFO("optoe2", 0x50) }, //For SFP+ w/ sff8472
+};
+
+/*
+ * Probe work that talks to hardware runs asynchronously in this domain so
+ * the adapters are usable as soon as they are registered. Entries are
+ * scheduled in order: mux clearing, SFF clients, CPLD discovery, report.
+ */
+static ASYNC_DOMAIN_EXCLUSIVE(switchboard_probe_domain);
+
+/**
+ * Deselect every PCA9548 on one I2C master, so no channel left selected by
+ * a previous owner of the bus joins two port buses together.
+ * @param  data  struct fpga_i2c_master to clear
+ */
+static void switchboard_async_mux_clear(void *data, async_cookie_t cookie)
+{
+    struct fpga_i2c_master *master = data;
+    struct switchboard_fpga_data *fpga_data = master->fpga_data;
+    unsigned char master_bus = master->master_bus;
+    unsigned char prev_i2c_switch = 0xFF;
+    int portid;
+
+    i2c_master_lock(master, I2C_PRIO_NORMAL);
+    for (portid = 0; portid < fpga_data->topo->n_buses; portid++) {
+        unsigned char switch_addr = fpga_data->topo->buses[portid].switch_addr;
+
+        if (fpga_data->topo->buses[portid].master_bus != master_bus ||
+                switch_addr == 0xFF || !fpga_data->i2c_adapter[portid])
+            continue;
+        if (switch_addr != prev_i2c_switch) {
+            smbus_access(fpga_data->i2c_adapter[portid], switch_addr, 0x00,
+                         I2C_SMBUS_WRITE, 0x00, I2C_SMBUS_BYTE, NULL);
+            prev_i2c_switch = switch_addr;
+        }
+    }
+    master->lasted_access_port = 0;
+    i2c_master_unlock(master);
+}
+
+/**
+ * Instantiate the sff8436 client of every SFF port. Waits for the mux
+ * clearing first since the EEPROM driver may read the module on bind.
+ */
+static void switchboard_async_sff_clients(void *data, async_cookie_t cookie)
+{
+    struct switchboard_fpga_data *fpga_data = data;
+    struct sff_device_data *sff_data;
+    struct i2c_client *client;
+    ktime_t start;
+    int portid;
+
+    async_synchronize_cookie_domain(cookie, &switchboard_probe_domain);
+    start = ktime_get();
+    fpga_data->probe_mux_us = ktime_us_delta(start, fpga_data->probe_async_start);
+
+    for (portid = 0; portid < fpga_data->topo->sff_ports; portid++) {
+        if (!fpga_data->i2c_adapter[portid] || !fpga_data->sff_devices[portid])
+            continue;
+        sff_data = dev_get_drvdata(fpga_data->sff_devices[portid]);
+        if (sff_data->port_type == QSFP) {
+            client = i2c_new_device(fpga_data->i2c_adapter[portid], &sff8436_eeprom_info[0]);
+        } else {
+            client = i2c_new_device(fpga_data->i2c_adapter[portid], &sff8436_eeprom_info[1]);
+        }
+        if (!client) {
+            printk(KERN_ALERT "Cannot create sff8436 client @port%d", portid);
+            continue;
+        }
+        fpga_data->sff_i2c_clients[portid] = client;
+        sysfs_create_link(&fpga_data->sff_devices[portid]->kobj,
+                          &client->dev.kobj, "i2c");
+    }
+    fpga_data->probe_client_us = ktime_us_delta(ktime_get(), start);
+}
+
+/**
+ * Read the switch CPLD versions. This also fills the register cache.
+ */
+static void switchboard_async_cpld_discover(void *data, async_cookie_t cookie)
+{
+    struct switchboard_fpga_data *fpga_data = data;
+    unsigned int cpld1_version = 0, cpld2_version = 0;
+    ktime_t start = ktime_get();
+
+    regmap_read(fpga_data->cpld[0].regmap, CPLD_VERSION, &cpld1_version);
+    regmap_read(fpga_data->cpld[1].regmap, CPLD_VERSION, &cpld2_version);
+    fpga_data->probe_cpld_us = ktime_us_delta(ktime_get(), start);
+
+    printk(KERN_INFO "CPLD1 VERSON: %2.2x\n", cpld1_version);
+    printk(KERN_INFO "CPLD2 VERSON: %2.2x\n", cpld2_version);
+}
+
+static void switchboard_async_report(void *data, async_cookie_t cookie)
+{
+    struct switchboard_fpga_data *fpga_data = data;
+
+    async_synchronize_cookie_domain(cookie, &switchboard_probe_domain);
+    dev_info(&fpga_data->fpga_dev->pdev->dev, "probe took %lld us: adapters %lld, sff devices %lld, "
+             "mux clear %lld, sff clients %lld, cpld %lld\n",
+             ktime_us_delta(ktime_get(), fpga_data->probe_start),
+             fpga_data->probe_adapter_us, fpga_data->probe_sff_us,
+             fpga_data->probe_mux_us, fpga_data->probe_client_us,
+             fpga_data->probe_cpld_us);
+}
+
+static int switchboard_drv_probe(struct platform_device *pdev)
+{
+    struct switchboard_fpga_data *fpga_data;
+    struct fpga_device *fpga_dev;
+    int ret = 0;
+    int portid_count;
+    int prio;
+    ktime_t phase_start;
+
+    /* The PCI probe passes its FPGA as platform data */
+    if (!dev_get_platdata(&pdev->dev))
+        return -ENODEV;
+    fpga_dev = *(struct fpga_device **)dev_get_platdata(&pdev->dev);
+
+    /* The device class need to be instantiated before this function called */
+    BUG_ON(fpga_dev->fpgafwclass == NULL);
+
+    fpga_data = devm_kzalloc(&pdev->dev, sizeof(struct switchboard_fpga_data),
+                             GFP_KERNEL);
+
+    if (!fpga_data)
+        return -ENOMEM;
+
+    fpga_data->probe_start = ktime_get();
+    fpga_data->fpga_dev = fpga_dev;
+    fpga_data->topo = fpga_dev->topo;
+    platform_set_drvdata(pdev, fpga_data);
+
+    // Set default read address to VERSION
+    fpga_data->fpga_read_addr = fpga_data->fpga_dev->data_base_addr + FPGA_VERSION;
+    fpga_data->cpld1_read_addr = 0x00;
+    fpga_data->cpld2_read_addr = 0x00;
+
+    spin_lock_init(&fpga_data->port_ctrl_lock);
+    hrtimer_init(&fpga_data->port_pulse_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    fpga_data->port_pulse_timer.function = sff_port_pulse_end;
+    for (ret = I2C_MASTER_CH_1 ; ret <= fpga_data->topo->i2c_masters; ret++) {
+        spin_lock_init(&fpga_data->i2c_master[ret - 1].lock);
+        for (prio = 0; prio < I2C_PRIO_MAX; prio++)
+            INIT_LIST_HEAD(&fpga_data->i2c_master[ret - 1].queue[prio]);
+        fpga_data->i2c_master[ret - 1].master_bus = ret;
+        fpga_data->i2c_master[ret - 1].fpga_data = fpga_data;
+        init_waitqueue_head(&fpga_data->i2c_master[ret - 1].wait);
+    }
+    spin_lock_init(&fpga_data->irq_lock);
+    spin_lock_init(&fpga_data->event_lock);
+    fpga_data->event_coalesce_ms = PORT_EVENT_COALESCE_MS;
+    INIT_DELAYED_WORK(&fpga_data->event_work, switchboard_port_event_work);
+    spin_lock_init(&fpga_data->ready_lock);
+    init_waitqueue_head(&fpga_data->ready_wait);
+    INIT_DELAYED_WORK(&fpga_data->ready_work, port_ready_work);
+    spin_lock_init(&fpga_data->psu_lock);
+    INIT_DELAYED_WORK(&fpga_data->psu_work, psu_telemetry_work);
+    mutex_init(&fpga_data->si5344_lock);
+    spin_lock_init(&fpga_data->ucd_lock);
+    init_waitqueue_head(&fpga_data->ucd_wait);
+    mutex_init(&fpga_data->hub_lock);
+    spin_lock_init(&fpga_data->hub_snap_lock);
+    INIT_DELAYED_WORK(&fpga_data->hub_work, hub_refresh_work);
+    mutex_init(&fpga_data->fan_fru_lock);
+    INIT_DELAYED_WORK(&fpga_data->fan_fru_work, fan_fru_work);
+    for (ret = 0; ret < FPGA_I2C_MASTER_MAX; ret++) {
+        INIT_WORK(&fpga_data->hub_master[ret].work, hub_master_work);
+        fpga_data->hub_master[ret].fpga_data = fpga_data;
+        fpga_data->hub_master[ret].master_bus = ret + 1;
+    }
+    spin_lock_init(&fpga_data->history_lock);
+    INIT_DELAYED_WORK(&fpga_data->history_work, port_history_work);
+    fpga_data->history = devm_kcalloc(&pdev->dev, fpga_data->topo->sff_ports,
+                                      sizeof(*fpga_data->history), GFP_KERNEL);
+    if (!fpga_data->history)
+        return -ENOMEM;
+    for (ret = 0; ret < fpga_data->topo->sff_ports; ret++) {
+        fpga_data->history[ret].status = ioread32(fpga_dev->data_base_addr +
+                                         SFF_PORT_STATUS_BASE + ret * 0x10) & STAT_MSK;
+    }
+
+    fpga_data->cpld[0].slave_addr = CPLD1_SLAVE_ADDR;
+    fpga_data->cpld[1].slave_addr = CPLD2_SLAVE_ADDR;
+    for (ret = 0; ret < ARRAY_SIZE(fpga_data->cpld); ret++) {
+        fpga_data->cpld[ret].fpga_data = fpga_data;
+        fpga_data->cpld[ret].regmap = devm_regmap_init(&pdev->dev, &switch_cpld_regmap_bus,
+                                                       &fpga_data->cpld[ret],
+                                                       &switch_cpld_regmap_config[ret]);
+        if (IS_ERR(fpga_data->cpld[ret].regmap)) {
+            printk(KERN_ERR "Cannot create CPLD%d register map\n", ret + 1);
+            return PTR_ERR(fpga_data->cpld[ret].regmap);
+        }
+    }
+
+    fpga_data->fpga = kobject_create_and_add("FPGA", &pdev->dev.kobj);
+    if (!fpga_data->fpga) {
+        return -ENOMEM;
+    }
+
+    ret = sysfs_create_group(fpga_data->fpga, &fpga_attr_grp);
+    if (ret != 0) {
+        printk(KERN_ERR "Cannot create FPGA sysfs attributes\n");
+        kobject_put(fpga_data->fpga);
+        return ret;
+    }
+
+    fpga_data->cpld1 = kobject_create_and_add("CPLD1", &pdev->dev.kobj);
+    if (!fpga_data->cpld1) {
+        sysfs_remove_group(fpga_data->fpga, &fpga_attr_grp);
+        kobject_put(fpga_data->fpga);
+        return -ENOMEM;
+    }
+    ret = sysfs_create_group(fpga_data->cpld1, &cpld1_attr_grp);
+    if (ret != 0) {
+        printk(KERN_ERR "Cannot create CPLD1 sysfs attributes\n");
+        kobject_put(fpga_data->cpld1);
+        sysfs_remove_group(fpga_data->fpga, &fpga_attr_grp);
+        kobject_put(fpga_data->fpga);
+        return ret;
+    }
+
+    fpga_data->cpld2 = kobject_create_and_add("CPLD2", &pdev->dev.kobj);
+    if (!fpga_data->cpld2) {
+        sysfs_remove_group(fpga_data->cpld1, &cpld1_attr_grp);
+        kobject_put(fpga_data->cpld1);
+        sysfs_remove_group(fpga_data->fpga, &fpga_attr_grp);
+        kobject_put(fpga_data->fpga);
+        return -ENOMEM;
+    }
+    ret = sysfs_create_group(fpga_data->cpld2, &cpld2_attr_grp);
+    if (ret != 0) {
+        printk(KERN_ERR "Cannot create CPLD2 sysfs attributes\n");
+        kobject_put(fpga_data->cpld2);
+        sysfs_remove_group(fpga_data->cpld1, &cpld1_attr_grp);
+        kobject_put(fpga_data->cpld1);
+        sysfs_remove_group(fpga_data->fpga, &fpga_attr_grp);
+        kobject_put(fpga_data->fpga);
+        return ret;
+    }
+
+    fpga_data->sff_dev = device_create(fpga_dev->fpgafwclass, NULL, MKDEV(0, 0), fpga_data, "sff_device");
+    if (IS_ERR(fpga_data->sff_dev)) {
+        printk(KERN_ERR "Failed to create sff device\n");
+        sysfs_remove_group(fpga_data->cpld2, &cpld2_attr_grp);
+        kobject_put(fpga_data->cpld2);
+        sysfs_remove_group(fpga_data->cpld1, &cpld1_attr_grp);
+        kobject_put(fpga_data->cpld1);
+        sysfs_remove_group(fpga_data->fpga, &fpga_attr_grp);
+        kobject_put(fpga_data->fpga);
+        return PTR_ERR(fpga_data->sff_dev);
+    }
+
+    ret = sysfs_create_group(&fpga_data->sff_dev->kobj, &sff_led_test_grp);
+    if (ret != 0) {
+        printk(KERN_ERR "Cannot create SFF attributes\n");
+        device_unregister(fpga_data->sff_dev);
+        sysfs_remove_group(fpga_data->cpld2, &cpld2_attr_grp);
+        kobject_put(fpga_data->cpld2);
+        sysfs_remove_group(fpga_data->cpld1, &cpld1_attr_grp);
+        kobject_put(fpga_data->cpld1);
+        sysfs_remove_group(fpga_data->fpga, &fpga_attr_grp);
+        kobject_put(fpga_data->fpga);
+        return ret;
+    }
+
+    ret = sysfs_create_group(&fpga_data->sff_dev->kobj, &sff_ctrl_grp);
+    if (ret != 0) {
+        printk(KERN_ERR "Cannot create SFF control attributes\n");
+        sysfs_remove_group(&fpga_data->sff_dev->kobj, &sff_led_test_grp);
+        device_unregister(fpga_data->sff_dev);
+        sysfs_remove_group(fpga_data->cpld2, &cpld2_attr_grp);
+        kobject_put(fpga_data->cpld2);
+        sysfs_remove_group(fpga_data->cpld1, &cpld1_attr_grp);
+        kobject_put(fpga_data->cpld1);
+        sysfs_remove_group(fpga_data->fpga, &fpga_attr_grp);
+        kobject_put(fpga_data->fpga);
+        return ret;
+    }
+
+    ret = sysfs_create_link(&pdev->dev.kobj, &fpga_data->sff_dev->kobj, "SFF");
+    if (ret != 0) {
+        sysfs_remove_group(&fpga_data->sff_dev->kobj, &sff_ctrl_grp);
+        sysfs_remove_group(&fpga_data->sff_dev->kobj, &sff_led_test_grp);
+        device_unregister(fpga_data->sff_dev);
+        sysfs_remove_group(fpga_data->cpld2, &cpld2_attr_grp);
+        kobject_put(fpga_data->cpld2);
+        sysfs_remove_group(fpga_data->cpld1, &cpld1_attr_grp);
+        kobject_put(fpga_data->cpld1);
+        sysfs_remove_group(fpga_data->fpga, &fpga_attr_grp);
+        kobject_put(fpga_data->fpga);
+        return ret;
+    }
+
+    phase_start = ktime_get();
+    for (portid_count = 0 ; portid_count < fpga_data->topo->n_buses ; portid_count++) {
+        fpga_data->i2c_adapter[portid_count] = switchboard_i2c_init(pdev, portid_count,
+                                               fpga_dev->instance ? -1 : fpga_data->topo->bus_offset);
+    }
+    fpga_data->probe_adapter_us = ktime_us_delta(ktime_get(), phase_start);
+
+    /* Init SFF devices */
+    phase_start = ktime_get();
+    for (portid_count = 0; portid_count < fpga_data->topo->sff_ports; portid_count++) {
+        if (fpga_data->i2c_adapter[portid_count])
+            fpga_data->sff_devices[portid_count] = switchboard_sff_init(fpga_data, portid_count);
+    }
+    fpga_data->probe_sff_us = ktime_us_delta(ktime_get(), phase_start);
+
+    printk(KERN_INFO "Virtual I2C buses created\n");
+
+    switchboard_irq_init(pdev);
+    /* Without port interrupts, the history is fed by sampling */
+    if (!fpga_data->irq) {
+        fpga_data->history_sample_ms = PORT_HISTORY_SAMPLE_MS;
+        schedule_delayed_work(&fpga_data->history_work,
+                              msecs_to_jiffies(fpga_data->history_sample_ms));
+    }
+
+#ifndef TEST_MODE
+    switchboard_psu_init(fpga_data, &pdev->dev);
+    switchboard_ucd_init(pdev);
+    switchboard_hub_init(pdev);
+    switchboard_fan_fru_init(pdev);
+#endif
+    fpga_data->si5344_bus = switchboard_find_bus(fpga_data->topo, "SI5344D");
+    if (fpga_data->si5344_bus >= 0 && fpga_data->i2c_adapter[fpga_data->si5344_bus] &&
+            sysfs_create_group(&pdev->dev.kobj, &si5344_attr_grp))
+        fpga_data->si5344_bus = -ENODEV;
+
+    /* Everything below touches the I2C buses and runs asynchronously */
+    fpga_data->probe_async_start = ktime_get();
+#ifndef TEST_MODE
+    for (portid_count = 0; portid_count < fpga_data->topo->i2c_masters; portid_count++) {
+        async_schedule_domain(switchboard_async_mux_clear, &fpga_data->i2c_master[portid_count],
+                              &switchboard_probe_domain);
+    }
+#endif
+    async_schedule_domain(switchboard_async_sff_clients, fpga_data, &switchboard_probe_domain);
+#ifndef TEST_MODE
+    async_schedule_domain(switchboard_async_cpld_discover, fpga_data, &switchboard_probe_domain);
+#endif
+    async_schedule_domain(switchboard_async_report, fpga_data, &switchboard_probe_domain);
+
+    /* The CPLD regmaps exist, let the FPGA ioctl restore their cache */
+    mutex_lock(&fpga_dev->switchboard_lock);
+    fpga_dev->switchboard = fpga_data;
+    mutex_unlock(&fpga_dev->switchboard_lock);
+    return 0;
+}
+
+static int switchboard_drv_remove(struct platform_device *pdev)
+{
+    struct switchboard_fpga_data *fpga_data = platform_get_drvdata(pdev);
+    int portid_count;
+    struct sff_device_data *rem_data;
+
+    mutex_lock(&fpga_data->fpga_dev->switchboard_lock);
+    fpga_data->fpga_dev->switchboard = NULL;
+    mutex_unlock(&fpga_data->fpga_dev->switchboard_lock);
+
+    async_synchronize_full_domain(&switchboard_probe_domain);
+
+    /* Finish a pending control pulse rather than leave ports half way */
+    if (hrtimer_cancel(&fpga_data->port_pulse_timer))
+        sff_port_pulse_end(&fpga_data->port_pulse_timer);
+    fpga_data->history_sample_ms = 0;
+    cancel_delayed_work_sync(&fpga_data->history_work);
+    if (fpga_data->si5344_bus >= 0 && fpga_data->i2c_adapter[fpga_data->si5344_bus])
+        sysfs_remove_group(&pdev->dev.kobj, &si5344_attr_grp);
+    switchboard_fan_fru_exit(pdev);
+    switchboard_hub_exit(pdev);
+    switchboard_ucd_exit(pdev);
+    switchboard_psu_exit(fpga_data);
+    switchboard_irq_exit(fpga_data);
+    cancel_delayed_work_sync(&fpga_data->event_work);
+    cancel_delayed_work_sync(&fpga_data->ready_work);
+    port_ready_update(fpga_data, ~0ULL, PORT_READY);
+
+    for (portid_count = 0; portid_count < fpga_data->topo->sff_ports; portid_count++) {
+        if (fpga_data->sff_i2c_clients[portid_count] == NULL)
+            continue;
+        sysfs_remove_link(&fpga_data->sff_devices[portid_count]->kobj, "i2c");
+        i2c_unregister_device(fpga_data->sff_i2c_clients[portid_count]);
+    }
+
+    for (portid_count = 0 ; portid_count < fpga_data->topo->n_buses ; portid_count++) {
+        if (fpga_data->i2c_adapter[portid_count] != NULL) {
+            info(KERN_INFO "<%x>", fpga_data->i2c_adapter[portid_count]);
+            device_remove_file(&fpga_data->i2c_adapter[portid_count]->dev, &dev_attr_priority);
+            i2c_del_adapter(fpga_data->i2c_adapter[portid_count]);
+        }
+    }
+
+    for (portid_count = 0; portid_count < fpga_data->topo->sff_ports; portid_count++) {
+        if (fpga_data->sff_devices[portid_count] != NULL) {
+            rem_data = dev_get_drvdata(fpga_data->sff_devices[portid_count]);
+            device_unregister(fpga_data->sff_devices[portid_count]);
+            put_device(fpga_data->sff_devices[portid_count]);
+            kfree(rem_data);
+        }
+    }
+
+    sysfs_remove_group(fpga_data->fpga, &fpga_attr_grp);
+    sysfs_remove_group(fpga_data->cpld1, &cpld1_attr_grp);
+    sysfs_remove_group(fpga_data->cpld2, &cpld2_attr_grp);
+    sysfs_remove_group(&fpga_data->sff_dev->kobj, &sff_ctrl_grp);
+    sysfs_remove_group(&fpga_data->sff_dev->kobj, &sff_led_test_grp);
+    kobject_put(fpga_data->fpga);
+    kobject_put(fpga_data->cpld1);
+    kobject_put(fpga_data->cpld2);
+    device_unregister(fpga_data->sff_dev);
+    devm_kfree(&pdev->dev, fpga_data);
+    return 0;
+}
+
+#ifdef TEST_MODE
+#define FPGA_PCI_BAR_NUM 2
+#else
+#define FPGA_PCI_BAR_NUM 0
+#endif
+
+
+
+static const struct pci_device_id fpga_id_table[] = {
+    {  PCI_VDEVICE(XILINX, FPGA_PCIE_DEVICE_ID) },
+    {  PCI_VDEVICE(TEST, TEST_PCIE_DEVICE_ID) },
+    {0, }
+};
+
+MODULE_DEVICE_TABLE(pci, fpga_id_table);
+
+/* Instance number of each switch FPGA, instance 0 keeps the legacy names */
+static DEFINE_IDA(fpga_instance_ida);
+static atomic_t fpga_count = ATOMIC_INIT(0);
+
+/* Built-in topology of the board module that loaded the driver */
+static const struct fpga_switchboard_topology *board_topo;
+
+/**
+ * Check a topology firmware image and build the topology it describes.
+ * The names and the LED description are taken from the built-in topology.
+ * @param  dev   device owning the allocations
+ * @param  fw    firmware image
+ * @return       topology, or an ERR_PTR
+ */
+static const struct fpga_switchboard_topology *fpga_topology_parse(struct device *dev,
+        const struct firmware *fw)
+{
+    const struct fpga_topology_fw_header *hdr = (const void *)fw->data;
+    const struct fpga_topology_fw_bus *fw_bus;
+    struct fpga_switchboard_topology *topo;
+    struct i2c_switch *buses;
+    unsigned int n_buses, sff_ports, cpld_bus, i;
+
+    if (fw->size < sizeof(*hdr))
+        return ERR_PTR(-EINVAL);
+    if (le32_to_cpu(hdr->magic) != FPGA_TOPOLOGY_FW_MAGIC ||
+            le16_to_cpu(hdr->version) != FPGA_TOPOLOGY_FW_VERSION)
+        return ERR_PTR(-EINVAL);
+
+    n_buses = le16_to_cpu(hdr->n_buses);
+    sff_ports = le16_to_cpu(hdr->sff_ports);
+    cpld_bus = le16_to_cpu(hdr->cpld_bus);
+    if (hdr->i2c_masters < I2C_MASTER_CH_1 || hdr->i2c_masters > FPGA_I2C_MASTER_MAX ||
+            n_buses == 0 || n_buses > FPGA_I2C_BUS_MAX ||
+            sff_ports == 0 || sff_ports > n_buses || sff_ports > SFF_PORT_MAX ||
+            cpld_bus >= n_buses)
+        return ERR_PTR(-EINVAL);
+    if (fw->size != sizeof(*hdr) + n_buses * sizeof(*fw_bus))
+        return ERR_PTR(-EINVAL);
+
+    topo = devm_kmemdup(dev, board_topo, sizeof(*topo), GFP_KERNEL);
+    buses = devm_kcalloc(dev, n_buses, sizeof(*buses), GFP_KERNEL);
+    if (!topo || !buses)
+        return ERR_PTR(-ENOMEM);
+
+    fw_bus = (const void *)(hdr + 1);
+    for (i = 0; i < n_buses; i++, fw_bus++) {
+        if (fw_bus->master_bus < I2C_MASTER_CH_1 || fw_bus->master_bus > hdr->i2c_masters ||
+                fw_bus->port_type > SFP ||
+                (fw_bus->switch_addr != 0xFF && fw_bus->channel > 7) ||
+                !memchr(fw_bus->calling_name, '\0', sizeof(fw_bus->calling_name)))
+            return ERR_PTR(-EINVAL);
+        if ((i < sff_ports) != (fw_bus->port_type != NONE))
+            return ERR_PTR(-EINVAL);
+        buses[i].master_bus = fw_bus->master_bus;
+        buses[i].switch_addr = fw_bus->switch_addr;
+        buses[i].channel = fw_bus->channel;
+        buses[i].port_type = fw_bus->port_type;
+        memcpy(buses[i].calling_name, fw_bus->calling_name, sizeof(buses[i].calling_name));
+    }
+
+    topo->i2c_masters = hdr->i2c_masters;
+    topo->buses = buses;
+    topo->n_buses = n_buses;
+    topo->sff_ports = sff_ports;
+    topo->cpld_bus = cpld_bus;
+    return topo;
+}
+
+/**
+ * Pick the topology of one FPGA. A "<driver_name>-topology.bin" firmware
+ * image overrides the built-in one, a bad image fails the probe rather
+ * than guess at the wiring.
+ * @return       topology, or an ERR_PTR
+ */
+static const struct fpga_switchboard_topology *fpga_topology_load(struct device *dev)
+{
+    const struct fpga_switchboard_topology *topo;
+    const struct firmware *fw;
+    char name[64];
+
+    snprintf(name, sizeof(name), "%s-topology.bin", board_topo->driver_name);
+    if (request_firmware_direct(&fw, name, dev))
+        return board_topo;
+
+    topo = fpga_topology_parse(dev, fw);
+    release_firmware(fw);
+    if (IS_ERR(topo)) {
+        dev_err(dev, "invalid topology in %s\n", name);
+        return topo;
+    }
+    dev_info(dev, "topology loaded from %s, %u buses, %u ports\n",
+             name, topo->n_buses, topo->sff_ports);
+    return topo;
+}
+
+static int fpga_pci_probe(struct pci_dev *pdev, const struct pci_device_id *id)
+{
+    int err;
+    struct device *dev = &pdev->dev;
+    struct fpga_device *fpga_dev;
+    uint32_t fpga_version;
+
+    fpga_dev = devm_kzalloc(dev, sizeof(*fpga_dev), GFP_KERNEL);
+    if (!fpga_dev)
+        return -ENOMEM;
+    mutex_init(&fpga_dev->fpga_lock);
+    mutex_init(&fpga_dev->switchboard_lock);
+
+    fpga_dev->topo = fpga_topology_load(dev);
+    if (IS_ERR(fpga_dev->topo))
+        return PTR_ERR(fpga_dev->topo);
+
+    if ((err = pci_enable_device(pdev))) {
+        dev_err(dev, "pci_enable_device probe error %d for device %s\n",
+                err, pci_name(pdev));
+        return err;
+    }
+
+    if ((err = pci_request_regions(pdev, fpga_dev->topo->pci_name)) < 0) {
+        dev_err(dev, "pci_request_regions error %d\n", err);
+        goto pci_disable;
+    }
+
+    /* bar0: data mmio region */
+    fpga_dev->data_mmio_start = pci_resource_start(pdev, FPGA_PCI_BAR_NUM);
+    fpga_dev->data_mmio_len = pci_resource_len(pdev, FPGA_PCI_BAR_NUM);
+    fpga_dev->data_base_addr = pci_iomap(pdev, FPGA_PCI_BAR_NUM, 0);
+    if (!fpga_dev->data_base_addr) {
+        dev_err(dev, "cannot iomap region of size %lu\n",
+                (unsigned long)fpga_dev->data_mmio_len);
+        goto pci_release;
+    }
+    dev_info(dev, "data_mmio iomap base = 0x%lx \n",
+             (unsigned long)fpga_dev->data_base_addr);
+    dev_info(dev, "data_mmio_start = 0x%lx data_mmio_len = %lu\n",
+             (unsigned long)fpga_dev->data_mmio_start,
+             (unsigned long)fpga_dev->data_mmio_len);
+
+    printk(KERN_INFO "FPGA PCIe driver probe OK.\n");
+    printk(KERN_INFO "FPGA ioremap registers of size %lu\n", (unsigned long)fpga_dev->data_mmio_len);
+    printk(KERN_INFO "FPGA Virtual BAR %d at %8.8lx - %8.8lx\n", FPGA_PCI_BAR_NUM,
+           (unsigned long)fpga_dev->data_base_addr,
+           (unsigned long)(fpga_dev->data_base_addr + fpga_dev->data_mmio_len));
+    printk(KERN_INFO "");
+    fpga_version = ioread32(fpga_dev->data_base_addr);
+    printk(KERN_INFO "FPGA VERSION : %8.8x\n", fpga_version);
+
+    fpga_dev->pci_dev = pdev;
+    fpga_dev->irq_type = "none";
+#ifndef TEST_MODE
+    /* FPGA interrupts stay masked until the switchboard takes them */
+    if (use_irq) {
+        iowrite32(0xffffffff, fpga_dev->data_base_addr + FPGA_INT_MASK);
+        pci_set_master(pdev);
+        /* pdev->irq is the MSI vector, or the INTx line if MSI is refused */
+        fpga_dev->irq_type = pci_enable_msi(pdev) ? "intx" : "msi";
+        if (pdev->irq > 0) {
+            fpga_dev->irq = pdev->irq;
+        } else {
+            dev_warn(dev, "no interrupt line, I2C transfers are polled\n");
+            fpga_dev->irq_type = "none";
+        }
+    }
+#endif
+
+    fpga_dev->instance = ida_simple_get(&fpga_instance_ida, 0, 0, GFP_KERNEL);
+    if (fpga_dev->instance < 0) {
+        err = fpga_dev->instance;
+        goto pci_unmap;
+    }
+    pci_set_drvdata(pdev, fpga_dev);
+
+    err = fpgafw_init(fpga_dev);
+    if (err < 0)
+        goto ida_remove;
+
+    /*
+     * The switchboard stays a platform device with no parent so instance 0
+     * keeps its /sys/devices/platform path. It finds the FPGA through the
+     * pointer passed as platform data.
+     */
+    fpga_dev->pdev = platform_device_register_data(NULL, fpga_dev->topo->driver_name,
+                     fpga_dev->instance ? fpga_dev->instance : PLATFORM_DEVID_NONE,
+                     &fpga_dev, sizeof(fpga_dev));
+    if (IS_ERR(fpga_dev->pdev)) {
+        err = PTR_ERR(fpga_dev->pdev);
+        goto fpgafw_remove;
+    }
+    atomic_inc(&fpga_count);
+    return 0;
+
+fpgafw_remove:
+    fpgafw_exit(fpga_dev);
+ida_remove:
+    ida_simple_remove(&fpga_instance_ida, fpga_dev->instance);
+pci_unmap:
+    pci_disable_msi(pdev);
+    pci_iounmap(pdev, fpga_dev->data_base_addr);
+    pci_release_regions(pdev);
+    pci_disable_device(pdev);
+    return err;
+
+pci_release:
+    pci_release_regions(pdev);
+pci_disable:
+    pci_disable_device(pdev);
+    return -EBUSY;
+}
+
+static void fpga_pci_remove(struct pci_dev *pdev)
+{
+    struct fpga_device *fpga_dev = pci_get_drvdata(pdev);
+
+    atomic_dec(&fpga_count);
+    platform_device_unregister(fpga_dev->pdev);
+    fpgafw_exit(fpga_dev);
+    ida_simple_remove(&fpga_instance_ida, fpga_dev->instance);
+    pci_disable_msi(pdev);
+    pci_iounmap(pdev, fpga_dev->data_base_addr);
+    pci_release_regions(pdev);
+    pci_disable_device(pdev);
+    printk(KERN_INFO "FPGA PCIe driver remove OK.\n");
+};
+
+static struct pci_driver pci_dev_ops = {
+    /* .name is the board PCI name, set by fpga_switchboard_init() */
+    .probe      = fpga_pci_probe,
+    .remove     = fpga_pci_remove,
+    .id_table   = fpga_id_table,
+};
+
+
+static struct platform_driver switchboard_drv = {
+    .probe  = switchboard_drv_probe,
+    .remove = __exit_p(switchboard_drv_remove),
+    .driver = {
+        /* .name is the board driver name, set by fpga_switchboard_init() */
+    },
+};
+
+enum {
+    READREG,
+    WRITEREG
+};
+
+struct fpga_reg_data {
+    uint32_t addr;
+    uint32_t value;
+};
+
+static int fpgafw_open(struct inode *inode, struct file *file)
+{
+    file->private_data = container_of(inode->i_cdev, struct fpga_device, cdev);
+    return 0;
+}
+
+static long fpgafw_unlocked_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    int ret = 0;
+    struct fpga_reg_data data;
+    struct fpga_device *fpga_dev = file->private_data;
+    struct switchboard_fpga_data *fpga_data;
+    mutex_lock(&fpga_dev->fpga_lock);
+
+#ifdef TEST_MODE
+    static  uint32_t status_reg;
+#endif
+    // Switch function to read and write.
+    switch (cmd) {
+    case READREG:
+        if (copy_from_user(&data, (void __user*)arg, sizeof(data)) != 0) {
+            mutex_unlock(&fpga_dev->fpga_lock);
+            return -EFAULT;
+        }
+        data.value = ioread32(fpga_dev->data_base_addr + data.addr);
+        if (copy_to_user((void __user*)arg , &data, sizeof(data)) != 0) {
+            mutex_unlock(&fpga_dev->fpga_lock);
+            return -EFAULT;
+        }
+#ifdef TEST_MODE
+        if (data.addr == 0x1210) {
+            switch (status_reg) {
+            case 0x0000 : status_reg = 0x8000;
+                break;
+
+            case 0x8080 : status_reg = 0x80C0;
+                break;
+            case 0x80C0 : status_reg = 0x80F0;
+                break;
+            case 0x80F0 : status_reg = 0x80F8;
+                break;
+
+            }
+            iowrite32(status_reg, fpga_dev->data_base_addr + 0x1210);
+        }
+#endif
+
+
+        break;
+    case WRITEREG:
+        if (copy_from_user(&data, (void __user*)arg, sizeof(data)) != 0) {
+            mutex_unlock(&fpga_dev->fpga_lock);
+            return -EFAULT;
+        }
+        iowrite32(data.value, fpga_dev->data_base_addr + data.addr);
+
+#ifdef TEST_MODE
+        if (data.addr == 0x1204) {
+            status_reg = 0x8080;
+            iowrite32(status_reg, fpga_dev->data_base_addr + 0x1210);
+        }
+#endif
+
+        break;
+    default:
+        mutex_unlock(&fpga_dev->fpga_lock);
+        return -EINVAL;
+    }
+    mutex_unlock(&fpga_dev->fpga_lock);
+    if (cmd == WRITEREG && data.addr == FPGA_SLAVE_CPLD_REST) {
+        /* Held across the sync so the switchboard cannot be removed under it */
+        mutex_lock(&fpga_dev->switchboard_lock);
+        fpga_data = fpga_dev->switchboard;
+        if (fpga_data)
+            switch_cpld_cache_sync(fpga_data);
+        mutex_unlock(&fpga_dev->switchboard_lock);
+    }
+    return ret;
+}
+
+
+const struct file_operations fpgafw_fops = {
+    .owner      = THIS_MODULE,
+    .open       = fpgafw_open,
+    .unlocked_ioctl = fpgafw_unlocked_ioctl,
+};
+
+
+static int fpgafw_init(struct fpga_device *fpga_dev) {
+    int err;
+
+    printk(KERN_INFO "Initializing the switchboard driver\n");
+    // Try to dynamically allocate a major number for the device -- more difficult but worth it
+    err = alloc_chrdev_region(&fpga_dev->devt, 0, 1, DEVICE_NAME);
+    if (err < 0) {
+        printk(KERN_ALERT "Failed to register a major number\n");
+        return err;
+    }
+    cdev_init(&fpga_dev->cdev, &fpgafw_fops);
+    fpga_dev->cdev.owner = THIS_MODULE;
+    err = cdev_add(&fpga_dev->cdev, fpga_dev->devt, 1);
+    if (err < 0) {
+        unregister_chrdev_region(fpga_dev->devt, 1);
+        printk(KERN_ALERT "Failed to add the FW upgrade device\n");
+        return err;
+    }
+    printk(KERN_INFO "Device registered correctly with major number %d\n", MAJOR(fpga_dev->devt));
+
+    // Register the device class
+    if (fpga_dev->instance)
+        snprintf(fpga_dev->class_name, sizeof(fpga_dev->class_name), "%s%d", fpga_dev->topo->class_name, fpga_dev->instance);
+    else
+        snprintf(fpga_dev->class_name, sizeof(fpga_dev->class_name), "%s", fpga_dev->topo->class_name);
+    fpga_dev->fpgafwclass = class_create(THIS_MODULE, fpga_dev->class_name);
+    if (IS_ERR(fpga_dev->fpgafwclass)) {               // Check for error and clean up if there is
+        cdev_del(&fpga_dev->cdev);
+        unregister_chrdev_region(fpga_dev->devt, 1);
+        printk(KERN_ALERT "Failed to register device class\n");
+        return PTR_ERR(fpga_dev->fpgafwclass);
+    }
+    printk(KERN_INFO "Device class registered correctly\n");
+
+    // Register the device driver
+    if (fpga_dev->instance)
+        fpga_dev->fpgafwdev = device_create(fpga_dev->fpgafwclass, NULL, fpga_dev->devt, fpga_dev, "%s%d", DEVICE_NAME, fpga_dev->instance);
+    else
+        fpga_dev->fpgafwdev = device_create(fpga_dev->fpgafwclass, NULL, fpga_dev->devt, fpga_dev, DEVICE_NAME);
+    if (IS_ERR(fpga_dev->fpgafwdev)) {                  // Clean up if there is an error
+        class_destroy(fpga_dev->fpgafwclass);           // Repeated code but the alternative is goto statements
+        cdev_del(&fpga_dev->cdev);
+        unregister_chrdev_region(fpga_dev->devt, 1);
+        printk(KERN_ALERT "Failed to create the FW upgrade device node\n");
+        return PTR_ERR(fpga_dev->fpgafwdev);
+    }
+    printk(KERN_INFO "FPGA fw upgrade device node created correctly\n");
+    return 0;
+}
+
+static void fpgafw_exit(struct fpga_device *fpga_dev) {
+    device_destroy(fpga_dev->fpgafwclass, fpga_dev->devt);  // remove the device
+    class_destroy(fpga_dev->fpgafwclass);                   // remove the device class
+    cdev_del(&fpga_dev->cdev);
+    unregister_chrdev_region(fpga_dev->devt, 1);            // unregister the major number
+    printk(KERN_INFO "Goodbye!\n");
+}
+
+/**
+ * Register the switchboard driver for one board.
+ * Called once from the init function of the board module.
+ * @param  topo    built-in board topology, must outlive the driver
+ * @return         0 on success, or an error code
+ */
+int fpga_switchboard_init(const struct fpga_switchboard_topology *topo)
+{
+    int rc;
+
+    if (topo->n_buses > FPGA_I2C_BUS_MAX || !topo->sff_ports || topo->sff_ports > topo->n_buses ||
+            topo->sff_ports > SFF_PORT_MAX || topo->cpld_bus >= topo->n_buses ||
+            !topo->i2c_masters || topo->i2c_masters > FPGA_I2C_MASTER_MAX)
+        return -EINVAL;
+
+    board_topo = topo;
+    pci_dev_ops.name = topo->pci_name;
+    switchboard_drv.driver.name = topo->driver_name;
+
+    rc = pci_register_driver(&pci_dev_ops);
+    if (rc)
+        return rc;
+    if (atomic_read(&fpga_count) == 0) {
+        printk(KERN_ALERT "FPGA PCIe device not found!\n");
+        pci_unregister_driver(&pci_dev_ops);
+        return -ENODEV;
+    }
+    rc = platform_driver_register(&switchboard_drv);
+    if (rc)
+        pci_unregister_driver(&pci_dev_ops);
+    return rc;
+}
+
+void fpga_switchboard_exit(void)
+{
+    platform_driver_unregister(&switchboard_drv);
+    pci_unregister_driver(&pci_dev_ops);
+}
@@ -0,0 +1,110 @@
+/*
+ * fpga_switchboard.h - board topology interface of the Celestica switch
+ * board FPGA/CPLD driver.
+ *
+ * Copyright (C) 2018 Celestica Corp.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * The FPGA I2C masters, transceiver port registers and switch CPLDs are
+ * the same on every board built around this FPGA. A board module only
+ * describes how its buses are wired and hands that to the shared driver:
+ *
+ *   static int __init board_init(void)
+ *   {
+ *       return fpga_switchboard_init(&board_topology);
+ *   }
+ */
+
+#ifndef _FPGA_SWITCHBOARD_H_
+#define _FPGA_SWITCHBOARD_H_
+
+#include <linux/types.h>
+
+#define I2C_MASTER_CH_1             1
+#define I2C_MASTER_CH_2             2
+#define I2C_MASTER_CH_3             3
+#define I2C_MASTER_CH_4             4
+#define I2C_MASTER_CH_5             5
+#define I2C_MASTER_CH_6             6
+#define I2C_MASTER_CH_7             7
+#define I2C_MASTER_CH_8             8
+#define I2C_MASTER_CH_9             9
+#define I2C_MASTER_CH_10            10
+#define I2C_MASTER_CH_11            11
+#define I2C_MASTER_CH_12            12
+#define I2C_MASTER_CH_13            13
+
+/* Limits of the FPGA, any board topology must fit in these */
+#define FPGA_I2C_MASTER_MAX         I2C_MASTER_CH_13
+#define FPGA_I2C_BUS_MAX            128
+#define SFF_PORT_MAX                64
+
+enum PORT_TYPE {
+    NONE,
+    QSFP,
+    SFP
+};
+
+struct i2c_switch {
+    unsigned char master_bus;   // I2C bus number
+    unsigned char switch_addr;  // PCA9548 device address, 0xFF if directly connect to a bus.
+    unsigned char channel;      // PCA9548 channel number. If the switch_addr is 0xFF, this value is ignored.
+    enum PORT_TYPE port_type;   // QSFP/SFP tranceiver port type.
+    char calling_name[20];      // Calling name.
+};
+
+/*
+ * Board description. Each entry of buses is exported as one virtual I2C
+ * bus, numbered from bus_offset. The first sff_ports entries are the front
+ * panel ports in FPGA port register order.
+ */
+struct fpga_switchboard_topology {
+    const char *driver_name;        // Platform device and driver name
+    const char *class_name;         // Device class of fwupgrade and the SFF devices
+    const char *pci_name;           // PCI driver and region name
+    unsigned int i2c_masters;       // FPGA I2C masters wired on the board
+    int bus_offset;
+    const struct i2c_switch *buses;
+    unsigned int n_buses;
+    unsigned int sff_ports;
+    unsigned int cpld_bus;          // Index in buses of the switch CPLD1/CPLD2 bus
+    const char *const *led_colors;  // Port LED colour names, by register value
+    unsigned int n_led_colors;
+};
+
+/*
+ * Optional topology override, loaded as firmware "<driver_name>-topology.bin"
+ * when the FPGA is probed. It replaces the bus table of the built-in
+ * topology; names and LED description are kept. All fields little endian.
+ */
+#define FPGA_TOPOLOGY_FW_MAGIC      0x4f544246  /* "FBTO" */
+#define FPGA_TOPOLOGY_FW_VERSION    1
+
+struct fpga_topology_fw_header {
+    __le32 magic;
+    __le16 version;
+    u8 i2c_masters;
+    u8 reserved;
+    __le16 n_buses;
+    __le16 sff_ports;
+    __le16 cpld_bus;
+    __le16 reserved2;
+};
+
+/* One per bus, following the header */
+struct fpga_topology_fw_bus {
+    u8 master_bus;
+    u8 switch_addr;
+    u8 channel;
+    u8 port_type;
+    char calling_name[20];
+};
+
+int fpga_switchboard_init(const struct fpga_switchboard_topology *topo);
+void fpga_switchboard_exit(void);
+
+#endif /* _FPGA_SWITCHBOARD_H_ */
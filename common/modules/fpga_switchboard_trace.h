@@ -0,0 +1,58 @@
+/*
+ * fpga_switchboard_trace.h - tracepoints of the switchboard FPGA driver.
+ *
+ * Copyright (C) 2018 Celestica Corp.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM fpga_switchboard
+
+#if !defined(_FPGA_SWITCHBOARD_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define _FPGA_SWITCHBOARD_TRACE_H_
+
+#include <linux/tracepoint.h>
+
+/*
+ * One transceiver port status transition, as recorded in the port
+ * event_history ring. ts is the CLOCK_MONOTONIC time of the transition.
+ */
+TRACE_EVENT(switchboard_port_status,
+
+    TP_PROTO(const char *port, u32 seq, u16 status, u16 changed, s64 ts),
+
+    TP_ARGS(port, seq, status, changed, ts),
+
+    TP_STRUCT__entry(
+        __string(port, port)
+        __field(u32, seq)
+        __field(u16, status)
+        __field(u16, changed)
+        __field(s64, ts)
+    ),
+
+    TP_fast_assign(
+        __assign_str(port, port);
+        __entry->seq = seq;
+        __entry->status = status;
+        __entry->changed = changed;
+        __entry->ts = ts;
+    ),
+
+    TP_printk("%s seq=%u status=0x%02x changed=0x%02x ts=%lld",
+              __get_str(port), __entry->seq, __entry->status,
+              __entry->changed, __entry->ts)
+);
+
+#endif /* _FPGA_SWITCHBOARD_TRACE_H_ */
+
+/* The trace header sits next to the driver, outside include/trace/events */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE fpga_switchboard_trace
+#include <trace/define_trace.h>
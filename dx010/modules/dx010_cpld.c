@@ -26,6 +26,11 @@
 #include <linux/err.h>
 #include <linux/platform_device.h>
 #include <linux/types.h>
+#include <linux/ktime.h>
+#include <linux/workqueue.h>
+#include <linux/kobject.h>
+#include <linux/seqlock.h>
+#include <linux/fs.h>
 #include <uapi/linux/stat.h>
 
 #define DRIVER_NAME "dx010_cpld"
@@ -89,41 +94,270 @@
 #define SSRR_ID_BANK2           0x296
 #define SSRR_ID_BANK3           0x396
 
-#define HST_CNTL2_QUICK         0x00
-#define HST_CNTL2_BYTE          0x01
-#define HST_CNTL2_BYTE_DATA     0x02
-#define HST_CNTL2_WORD_DATA     0x03
-#define HST_CNTL2_BLOCK         0x05
+/* OPCODE: bytes to read in [7:4], command bytes to write in [3:0] */
+#define CPLD_OPCODE(rd, wr)     ((rd) << 4 | (wr))
+#define CPLD_READ_MAX           15
+/* Data bytes of a write, the command byte counts in the write length */
+#define CPLD_WRITE_MAX          14
+
+#define QSFP_EEPROM_ADDR        0x50
+#define QSFP_PAGE_SELECT        127
+
+/* Presence and interrupt bitmap sampling, and the change log kept */
+#define PORT_SAMPLE_MS          50
+#define PORT_SAMPLE_MIN_MS      10
+#define PORT_SAMPLE_MAX_MS      10000
+#define PORT_EVENT_LOG_LEN      32
+#define PORT_MAX_AGE_MS         100
+
+#define SSRR_BUSY               0x40
+#define SSRR_ERROR              0x80
+
+/*
+ * A bridge transaction of CPLD_READ_MAX bytes takes about 2 ms. Spin on the
+ * busy flag for a short while, then sleep, and give up at the deadline.
+ */
+#define CPLD_BUSY_SPIN_US       50
+#define CPLD_BUSY_SLEEP_US      100
+#define CPLD_BUSY_TIMEOUT_MS    50
+#define CPLD_RESET_US           3000
 
 struct dx010_i2c_data {
         int portid;
 };
 
+#define DX010_BANKS             3
+
+/* Registers of one CPLD I2C bridge bank */
+struct dx010_bank {
+        short portid;
+        short opcode;
+        short devaddr;
+        short cmdbyte0;
+        short ssrr;
+        short writedata;
+        short readdata;
+};
+
+/* One bridge bank, independent from the others */
+struct dx010_bank_data {
+        const struct dx010_bank *regs;
+        struct mutex       lock;        /* For the bank registers and counters */
+        u64                busy_waits;
+        u64                busy_us;     /* Total time waited for the busy flag */
+        u64                timeouts;
+        u64                resets;
+};
+
+enum port_bitmap {
+        PORT_LPMOD,
+        PORT_ABS,
+        PORT_INT,
+};
+
+/* One change of the presence or interrupt bitmap */
+struct dx010_port_event {
+        s64                ts;          /* CLOCK_MONOTONIC time in ns */
+        u32                modprs;
+        u32                modirq;
+        u32                prs_changed;
+        u32                irq_changed;
+};
+
+/* Published copy of the port bitmaps, the layout of qsfp_bitmaps */
+struct dx010_port_bitmaps {
+        u64                gen;         /* Bumped when any bitmap changes */
+        s64                ts;          /* CLOCK_MONOTONIC time of the last refresh in ns */
+        u32                lpmode;
+        u32                modprs;
+        u32                modirq;
+        u32                reserved;
+};
+
+/* Port bitmap registers of a run of QSFP ports */
+struct dx010_port_reg {
+        int first;              /* First port, 1 based */
+        int count;
+        short lpmod;
+        short abs;
+        short irq;
+};
+
+static const struct dx010_port_reg dx010_port_regs[] = {
+        { 1, 8, LPMOD0108, ABS0108, INT0108 },
+        { 9, 2, LPMOD0910, ABS0910, INT0910 },
+        { 11, 8, LPMOD1118, ABS1118, INT1118 },
+        { 19, 3, LPMOD1921, ABS1921, INT1921 },
+        { 22, 8, LPMOD2229, ABS2229, INT2229 },
+        { 30, 3, LPMOD3032, ABS3032, INT3032 },
+};
+
 struct dx010_cpld_data {
         struct i2c_adapter *i2c_adapter[LENGTH_PORT_CPLD];
-        struct mutex       cpld_lock;
+        struct mutex       cpld_lock;   /* For the port bitmap registers */
+        struct dx010_bank_data bank[DX010_BANKS];
+        int                page[PORT_BANK3_END];    /* Selected QSFP page, -1 if unknown */
+        struct device      *dev;
+        struct delayed_work sample_work;
+        unsigned int       sample_ms;
+        unsigned int       max_age_ms;
+        seqlock_t          bitmap_seq;  /* Publishes bitmaps to lockless readers */
+        struct dx010_port_bitmaps bitmaps;
+        struct dx010_port_event events[PORT_EVENT_LOG_LEN];
+        unsigned int       event_head;  /* Next slot to write */
+        unsigned int       event_count;
 };
 
 struct dx010_cpld_data *cpld_data;
 
-static ssize_t get_lpmode(struct device *dev, struct device_attribute *devattr,
-                char *buf)
+/**
+ * Assemble a port bitmap from its CPLD registers. Caller holds cpld_lock.
+ * @param  which    LPMOD, ABS or INT registers.
+ * @return          bitmap, bit 0 is port 1.
+ */
+static u32 dx010_read_bitmap(enum port_bitmap which)
 {
-        unsigned long lpmod = 0;
+        const struct dx010_port_reg *reg;
+        u32 bitmap = 0;
+        short port;
+        int i;
+
+        for (i = 0; i < ARRAY_SIZE(dx010_port_regs); i++) {
+                reg = &dx010_port_regs[i];
+                port = which == PORT_LPMOD ? reg->lpmod :
+                       which == PORT_ABS ? reg->abs : reg->irq;
+                bitmap |= (inb(port) & GENMASK(reg->count - 1, 0)) << (reg->first - 1);
+        }
+        return bitmap;
+}
 
-        mutex_lock(&cpld_data->cpld_lock);
+/**
+ * Tell userspace about a change of the port bitmaps: wake poll() on the
+ * sysfs files and send a change uevent.
+ * @param  ev       the logged change.
+ */
+static void dx010_port_notify(const struct dx010_port_event *ev)
+{
+        struct kobject *kobj = &cpld_data->dev->kobj;
+        char modprs[32], modirq[32], prs_changed[32], irq_changed[32];
+        char *envp[] = { modprs, modirq, prs_changed, irq_changed, NULL };
+
+        if (ev->prs_changed)
+                sysfs_notify(kobj, NULL, "qsfp_modprs");
+        if (ev->irq_changed)
+                sysfs_notify(kobj, NULL, "qsfp_modirq");
+        sysfs_notify(kobj, NULL, "qsfp_bitmaps");
+        sysfs_notify(kobj, NULL, "qsfp_events");
+
+        snprintf(modprs, sizeof(modprs), "QSFP_MODPRS=0x%8.8x", ev->modprs);
+        snprintf(modirq, sizeof(modirq), "QSFP_MODIRQ=0x%8.8x", ev->modirq);
+        snprintf(prs_changed, sizeof(prs_changed), "QSFP_MODPRS_CHANGED=0x%8.8x",
+                        ev->prs_changed);
+        snprintf(irq_changed, sizeof(irq_changed), "QSFP_MODIRQ_CHANGED=0x%8.8x",
+                        ev->irq_changed);
+        kobject_uevent_env(kobj, KOBJ_CHANGE, envp);
+}
 
-        lpmod =
-                (inb(LPMOD3032) & 0x07) << (24+5) |
-                inb(LPMOD2229) << (24-3)  |
-                (inb(LPMOD1921) & 0x07) << (16 + 2) |
-                inb(LPMOD1118) << (16-6) |
-                (inb(LPMOD0910) & 0x03 ) << 8 |
-                inb(LPMOD0108);
+/**
+ * Read the port bitmaps and publish them. Caller holds cpld_lock.
+ * A port whose presence changed loses its cached QSFP page select.
+ * @param  ev       filled in and logged on a presence or interrupt change,
+ *                  NULL to publish without logging.
+ * @return          true if ev was logged.
+ */
+static bool dx010_port_refresh_locked(struct dx010_port_event *ev)
+{
+        struct dx010_port_bitmaps *b = &cpld_data->bitmaps;
+        u32 lpmode, modprs, modirq;
+        u32 prs_changed, irq_changed;
+        s64 now;
+        int i;
+
+        lpmode = dx010_read_bitmap(PORT_LPMOD);
+        modprs = dx010_read_bitmap(PORT_ABS);
+        modirq = dx010_read_bitmap(PORT_INT);
+        now = ktime_to_ns(ktime_get());
+        prs_changed = modprs ^ b->modprs;
+        irq_changed = modirq ^ b->modirq;
+
+        for (i = 0; i < PORT_BANK3_END; i++) {
+                if (prs_changed & BIT(i))
+                        cpld_data->page[i] = -1;
+        }
+
+        write_seqlock(&cpld_data->bitmap_seq);
+        if (lpmode != b->lpmode || prs_changed || irq_changed)
+                b->gen++;
+        b->ts = now;
+        b->lpmode = lpmode;
+        b->modprs = modprs;
+        b->modirq = modirq;
+        write_sequnlock(&cpld_data->bitmap_seq);
+
+        if (!ev || !(prs_changed || irq_changed))
+                return false;
+
+        ev->ts = now;
+        ev->modprs = modprs;
+        ev->modirq = modirq;
+        ev->prs_changed = prs_changed;
+        ev->irq_changed = irq_changed;
+        cpld_data->events[cpld_data->event_head] = *ev;
+        cpld_data->event_head = (cpld_data->event_head + 1) % PORT_EVENT_LOG_LEN;
+        if (cpld_data->event_count < PORT_EVENT_LOG_LEN)
+                cpld_data->event_count++;
+
+        return true;
+}
 
+/* Refresh the published bitmaps from the CPLD */
+static void dx010_port_refresh(void)
+{
+        struct dx010_port_event ev;
+        bool changed;
+
+        mutex_lock(&cpld_data->cpld_lock);
+        changed = dx010_port_refresh_locked(&ev);
         mutex_unlock(&cpld_data->cpld_lock);
 
-        return sprintf(buf,"0x%8.8lx\n", lpmod & 0xffffffff);
+        if (changed)
+                dx010_port_notify(&ev);
+}
+
+/**
+ * Get the published port bitmaps without touching the CPLD, unless they
+ * are older than max_age_ms because the sampler fell behind.
+ * @param  snap     copy of the bitmaps.
+ */
+static void dx010_port_snapshot(struct dx010_port_bitmaps *snap)
+{
+        unsigned int seq;
+        s64 max_age;
+
+        max_age = (s64)ACCESS_ONCE(cpld_data->max_age_ms) * NSEC_PER_MSEC;
+        do {
+                seq = read_seqbegin(&cpld_data->bitmap_seq);
+                *snap = cpld_data->bitmaps;
+        } while (read_seqretry(&cpld_data->bitmap_seq, seq));
+
+        if (ktime_to_ns(ktime_get()) - snap->ts <= max_age)
+                return;
+
+        dx010_port_refresh();
+        do {
+                seq = read_seqbegin(&cpld_data->bitmap_seq);
+                *snap = cpld_data->bitmaps;
+        } while (read_seqretry(&cpld_data->bitmap_seq, seq));
+}
+
+static ssize_t get_lpmode(struct device *dev, struct device_attribute *devattr,
+                char *buf)
+{
+        struct dx010_port_bitmaps snap;
+
+        dx010_port_snapshot(&snap);
+
+        return sprintf(buf,"0x%8.8x\n", snap.lpmode);
 }
 
 static ssize_t set_lpmode(struct device *dev, struct device_attribute *devattr,
@@ -147,67 +381,230 @@ static ssize_t set_lpmode(struct device *dev, struct device_attribute *devattr,
         outb( (lpmod >> 18) & 0x07, LPMOD1921);
         outb( (lpmod >> 21) & 0xFF, LPMOD2229);
         outb( (lpmod >> 29) & 0x07, LPMOD3032);
+        dx010_port_refresh_locked(NULL);
 
         mutex_unlock(&cpld_data->cpld_lock);
 
         return count;
 }
 
-static ssize_t get_modprs(struct device *dev, struct device_attribute *devattr,
-                char *buf)
+/**
+ * Set and clear LPMODE bits with one read-modify-write of each register
+ * holding an affected port, leaving the other ports alone.
+ * @param  set      ports to put in low power mode, bit 0 is port 1.
+ * @param  clear    ports to take out of low power mode.
+ */
+static void dx010_update_lpmode(u32 set, u32 clear)
 {
-        unsigned long present;
+        const struct dx010_port_reg *reg;
+        struct dx010_port_bitmaps *b = &cpld_data->bitmaps;
+        u32 lpmode, mask;
+        u8 val;
+        int i;
 
         mutex_lock(&cpld_data->cpld_lock);
+        lpmode = b->lpmode;
+        for (i = 0; i < ARRAY_SIZE(dx010_port_regs); i++) {
+                reg = &dx010_port_regs[i];
+                mask = GENMASK(reg->count - 1, 0) << (reg->first - 1);
+                if (!((set | clear) & mask))
+                        continue;
+
+                val = inb(reg->lpmod);
+                val &= ~((clear & mask) >> (reg->first - 1));
+                val |= (set & mask) >> (reg->first - 1);
+                outb(val, reg->lpmod);
+
+                lpmode &= ~mask;
+                lpmode |= ((u32)val << (reg->first - 1)) & mask;
+        }
 
-        present =
-                (inb(ABS3032) & 0x07) << (24+5) |
-                inb(ABS2229) << (24-3)  |
-                (inb(ABS1921) & 0x07) << (16 + 2) |
-                inb(ABS1118) << (16-6) |
-                (inb(ABS0910) & 0x03) << 8 |
-                inb(ABS0108);
-
+        write_seqlock(&cpld_data->bitmap_seq);
+        if (lpmode != b->lpmode)
+                b->gen++;
+        b->lpmode = lpmode;
+        write_sequnlock(&cpld_data->bitmap_seq);
         mutex_unlock(&cpld_data->cpld_lock);
+}
+
+/*
+ * Write "<set> <clear>", two hex port bitmaps, to change only those ports,
+ * e.g. "0x1 0x0" puts port 1 in low power mode and "0 0x6" takes ports 2
+ * and 3 out of it.
+ */
+static ssize_t set_lpmode_mask(struct device *dev, struct device_attribute *devattr,
+                const char *buf, size_t count)
+{
+        u32 set, clear;
+
+        if (sscanf(buf, "%x %x", &set, &clear) != 2)
+                return -EINVAL;
+        if (set & clear)
+                return -EINVAL;
 
-        return sprintf(buf,"0x%8.8lx\n", present & 0xffffffff);
+        dx010_update_lpmode(set, clear);
+
+        return count;
+}
+
+static ssize_t get_modprs(struct device *dev, struct device_attribute *devattr,
+                char *buf)
+{
+        struct dx010_port_bitmaps snap;
+
+        dx010_port_snapshot(&snap);
+
+        return sprintf(buf,"0x%8.8x\n", snap.modprs);
 }
 
 static ssize_t get_modirq(struct device *dev, struct device_attribute *devattr,
                 char *buf)
 {
-        unsigned long irq;
+        struct dx010_port_bitmaps snap;
 
-        mutex_lock(&cpld_data->cpld_lock);
+        dx010_port_snapshot(&snap);
+
+        return sprintf(buf,"0x%8.8x\n", snap.modirq);
+}
+
+static ssize_t get_bridge_stats(struct device *dev, struct device_attribute *devattr,
+                char *buf)
+{
+        struct dx010_bank_data *bank_data;
+        ssize_t len = 0;
+        int i;
+
+        for (i = 0; i < DX010_BANKS; i++) {
+                bank_data = &cpld_data->bank[i];
+                mutex_lock(&bank_data->lock);
+                len += sprintf(buf + len, "bank%d waits %llu busy_us %llu timeouts %llu resets %llu\n",
+                                i + 1, bank_data->busy_waits, bank_data->busy_us,
+                                bank_data->timeouts, bank_data->resets);
+                mutex_unlock(&bank_data->lock);
+        }
+
+        return len;
+}
+
+static ssize_t get_sample_ms(struct device *dev, struct device_attribute *devattr,
+                char *buf)
+{
+        return sprintf(buf, "%u\n", ACCESS_ONCE(cpld_data->sample_ms));
+}
+
+static ssize_t set_sample_ms(struct device *dev, struct device_attribute *devattr,
+                const char *buf, size_t count)
+{
+        unsigned int ms;
+        int err;
+
+        err = kstrtouint(buf, 10, &ms);
+        if (err)
+                return err;
+        if (ms < PORT_SAMPLE_MIN_MS || ms > PORT_SAMPLE_MAX_MS)
+                return -EINVAL;
+
+        ACCESS_ONCE(cpld_data->sample_ms) = ms;
+        mod_delayed_work(system_wq, &cpld_data->sample_work, 0);
+
+        return count;
+}
 
-        irq =
-                (inb(INT3032) & 0x07) << (24+5) |
-                inb(INT2229) << (24-3)  |
-                (inb(INT1921) & 0x07) << (16 + 2) |
-                inb(INT1118) << (16-6) |
-                (inb(INT0910) & 0x03) << 8 |
-                inb(INT0108);
+static ssize_t get_qsfp_events(struct device *dev, struct device_attribute *devattr,
+                char *buf)
+{
+        struct dx010_port_event *ev;
+        unsigned int i, slot;
+        ssize_t len = 0;
 
+        mutex_lock(&cpld_data->cpld_lock);
+        for (i = 0; i < cpld_data->event_count; i++) {
+                slot = (cpld_data->event_head + PORT_EVENT_LOG_LEN -
+                        cpld_data->event_count + i) % PORT_EVENT_LOG_LEN;
+                ev = &cpld_data->events[slot];
+                len += sprintf(buf + len, "%lld modprs 0x%8.8x changed 0x%8.8x modirq 0x%8.8x changed 0x%8.8x\n",
+                                ev->ts, ev->modprs, ev->prs_changed,
+                                ev->modirq, ev->irq_changed);
+        }
         mutex_unlock(&cpld_data->cpld_lock);
 
-        return sprintf(buf,"0x%8.8lx\n", irq  & 0xffffffff);
+        return len;
+}
+
+static ssize_t get_max_age_ms(struct device *dev, struct device_attribute *devattr,
+                char *buf)
+{
+        return sprintf(buf, "%u\n", ACCESS_ONCE(cpld_data->max_age_ms));
+}
+
+static ssize_t set_max_age_ms(struct device *dev, struct device_attribute *devattr,
+                const char *buf, size_t count)
+{
+        unsigned int ms;
+        int err;
+
+        err = kstrtouint(buf, 10, &ms);
+        if (err)
+                return err;
+
+        ACCESS_ONCE(cpld_data->max_age_ms) = ms;
+
+        return count;
+}
+
+static ssize_t qsfp_bitmaps_read(struct file *filp, struct kobject *kobj,
+                struct bin_attribute *attr, char *buf, loff_t off, size_t count)
+{
+        struct dx010_port_bitmaps snap;
+
+        dx010_port_snapshot(&snap);
+
+        return memory_read_from_buffer(buf, count, &off, &snap, sizeof(snap));
 }
 
 static DEVICE_ATTR(qsfp_lpmode, S_IRUGO | S_IWUSR, get_lpmode, set_lpmode);
+static DEVICE_ATTR(qsfp_lpmode_mask, S_IWUSR, NULL, set_lpmode_mask);
 static DEVICE_ATTR(qsfp_modprs, S_IRUGO, get_modprs, NULL);
 static DEVICE_ATTR(qsfp_modirq, S_IRUGO, get_modirq, NULL);
+static DEVICE_ATTR(qsfp_events, S_IRUGO, get_qsfp_events, NULL);
+static DEVICE_ATTR(sample_ms, S_IRUGO | S_IWUSR, get_sample_ms, set_sample_ms);
+static DEVICE_ATTR(max_age_ms, S_IRUGO | S_IWUSR, get_max_age_ms, set_max_age_ms);
+static DEVICE_ATTR(bridge_stats, S_IRUGO, get_bridge_stats, NULL);
+static BIN_ATTR_RO(qsfp_bitmaps, sizeof(struct dx010_port_bitmaps));
 
 static struct attribute *dx010_lpc_attrs[] = {
         &dev_attr_qsfp_lpmode.attr,
+        &dev_attr_qsfp_lpmode_mask.attr,
         &dev_attr_qsfp_modprs.attr,
         &dev_attr_qsfp_modirq.attr,
+        &dev_attr_qsfp_events.attr,
+        &dev_attr_sample_ms.attr,
+        &dev_attr_max_age_ms.attr,
+        &dev_attr_bridge_stats.attr,
+        NULL,
+};
+
+static struct bin_attribute *dx010_lpc_bin_attrs[] = {
+        &bin_attr_qsfp_bitmaps,
         NULL,
 };
 
 static struct attribute_group dx010_lpc_attr_grp = {
         .attrs = dx010_lpc_attrs,
+        .bin_attrs = dx010_lpc_bin_attrs,
 };
 
+/*
+ * The CPLD has no interrupt line wired to the LPC serial IRQ, so sample the
+ * presence and interrupt bitmaps and log each change.
+ */
+static void dx010_port_sample(struct work_struct *work)
+{
+        dx010_port_refresh();
+        schedule_delayed_work(&cpld_data->sample_work,
+                        msecs_to_jiffies(ACCESS_ONCE(cpld_data->sample_ms)));
+}
+
 static struct resource cel_dx010_lpc_resources[] = {
         {
                 .flags  = IORESOURCE_IO,
@@ -230,166 +627,375 @@ static struct platform_device cel_dx010_lpc_dev = {
 };
 
 
+static const struct dx010_bank dx010_banks[DX010_BANKS] = {
+        { PORT_ID_BANK1, OPCODE_ID_BANK1, DEVADDR_ID_BANK1, CMDBYT_ID_BANK1,
+          SSRR_ID_BANK1, WRITE_ID_BANK1, READ_ID_BANK1 },
+        { PORT_ID_BANK2, OPCODE_ID_BANK2, DEVADDR_ID_BANK2, CMDBYT_ID_BANK2,
+          SSRR_ID_BANK2, WRITE_ID_BANK2, READ_ID_BANK2 },
+        { PORT_ID_BANK3, OPCODE_ID_BANK3, DEVADDR_ID_BANK3, CMDBYT_ID_BANK3,
+          SSRR_ID_BANK3, WRITE_ID_BANK3, READ_ID_BANK3 },
+};
+
 /**
- * Read eeprom of QSFP device.
- * @param  a        i2c adapter.
- * @param  addr     address to read.
- * @param  new_data QSFP port number struct.
- * @param  cmd      i2c command.
- * @return          0 if not error, else the error code.
+ * Find the bridge bank serving a port.
+ * @param  portid   port number, 1 based.
+ * @return          the bank, or NULL for an invalid port.
  */
-static int i2c_read_eeprom(struct i2c_adapter *a, u16 addr,
-               struct dx010_i2c_data *new_data, u8 cmd, union i2c_smbus_data *data){
-
-        u32 reg;
-        int ioBase=0;
-        char byte;
-        short temp;
-        short portid, opcode, devaddr, cmdbyte0, ssrr, writedata, readdata;
-        __u16 word_data;
-        char read_byte;
-        int error = -EIO;
+static struct dx010_bank_data *dx010_port_bank(int portid)
+{
+        if ((portid >= PORT_BANK1_START && portid <= PORT_BANK1_END)
+                        || portid == PORT_SFPP1 || portid == PORT_SFPP2)
+                return &cpld_data->bank[0];
+        if (portid >= PORT_BANK2_START && portid <= PORT_BANK2_END)
+                return &cpld_data->bank[1];
+        if (portid >= PORT_BANK3_START && portid <= PORT_BANK3_END)
+                return &cpld_data->bank[2];
+        return NULL;
+}
 
-        mutex_lock(&cpld_data->cpld_lock);
+/**
+ * Wait for a bridge bank to finish its transaction. Caller holds the bank
+ * lock.
+ * @return          0 when idle, -ETIMEDOUT at the deadline.
+ */
+static int cpld_wait_idle(struct dx010_bank_data *bank_data)
+{
+        ktime_t start = ktime_get();
+        ktime_t spin_end = ktime_add_us(start, CPLD_BUSY_SPIN_US);
+        ktime_t deadline = ktime_add_ms(start, CPLD_BUSY_TIMEOUT_MS);
+        ktime_t now;
+        int error = 0;
 
-        if (((new_data->portid >= PORT_BANK1_START)
-                        && (new_data->portid <= PORT_BANK1_END))
-                        || (new_data->portid == PORT_SFPP1)
-                        || (new_data->portid == PORT_SFPP2))
-        {
-                portid = PORT_ID_BANK1;
-                opcode = OPCODE_ID_BANK1;
-                devaddr = DEVADDR_ID_BANK1;
-                cmdbyte0 = CMDBYT_ID_BANK1;
-                ssrr = SSRR_ID_BANK1;
-                writedata = WRITE_ID_BANK1;
-                readdata = READ_ID_BANK1;
-        }else if ((new_data->portid >= PORT_BANK2_START) && (new_data->portid <= PORT_BANK2_END)){
-                portid = PORT_ID_BANK2;
-                opcode = OPCODE_ID_BANK2;
-                devaddr = DEVADDR_ID_BANK2;
-                cmdbyte0 = CMDBYT_ID_BANK2;
-                ssrr = SSRR_ID_BANK2;
-                writedata = WRITE_ID_BANK2;
-                readdata = READ_ID_BANK2;
-        }else if ((new_data->portid  >= PORT_BANK3_START) && (new_data->portid  <= PORT_BANK3_END)){
-                portid = PORT_ID_BANK3;
-                opcode = OPCODE_ID_BANK3;
-                devaddr = DEVADDR_ID_BANK3;
-                cmdbyte0 = CMDBYT_ID_BANK3;
-                ssrr = SSRR_ID_BANK3;
-                writedata = WRITE_ID_BANK3;
-                readdata = READ_ID_BANK3;
-        }else{
-            /* Invalid parameter! */
-                error = -EINVAL;
-                goto exit;
+        while (inb(bank_data->regs->ssrr) & SSRR_BUSY) {
+                now = ktime_get();
+                if (ktime_after(now, deadline)) {
+                        bank_data->timeouts++;
+                        error = -ETIMEDOUT;
+                        break;
+                }
+                if (ktime_before(now, spin_end))
+                        cpu_relax();
+                else
+                        usleep_range(CPLD_BUSY_SLEEP_US, 2 * CPLD_BUSY_SLEEP_US);
         }
 
-        while ((inb(ioBase + ssrr) & 0x40));
-        if ((inb(ioBase + ssrr) & 0x80) == 0x80) {
-                error = -EIO;
+        bank_data->busy_waits++;
+        bank_data->busy_us += ktime_us_delta(ktime_get(), start);
+        return error;
+}
+
+/**
+ * Reset the port controller of a bridge bank after an error.
+ * Caller holds the bank lock.
+ */
+static void cpld_bank_reset(struct dx010_bank_data *bank_data)
+{
+        outb(0x00, bank_data->regs->ssrr);
+        usleep_range(CPLD_RESET_US, CPLD_RESET_US + 500);
+        outb(0x01, bank_data->regs->ssrr);
+        bank_data->resets++;
+}
+
+/**
+ * Run one read transaction on a bridge bank. Caller holds the bank lock.
+ * @param  bank_data bridge bank of the port.
+ * @param  portid   port number, 1 based.
+ * @param  addr     7 bit device address.
+ * @param  cmd      command byte, sent when cmd_len is 1.
+ * @param  cmd_len  number of command bytes, 0 or 1.
+ * @param  buf      read data.
+ * @param  len      number of bytes to read, up to CPLD_READ_MAX.
+ * @return          0 if not error, else the error code.
+ */
+static int cpld_i2c_read(struct dx010_bank_data *bank_data, int portid, u16 addr,
+                u8 cmd, int cmd_len, u8 *buf, int len)
+{
+        const struct dx010_bank *bank = bank_data->regs;
+        int error;
+        int i;
+
+        error = cpld_wait_idle(bank_data);
+        if (error || (inb(bank->ssrr) & SSRR_ERROR)) {
                 /* Read error reset the port */
-                outb(0x00, ioBase + ssrr);
-                udelay(3000);
-                outb(0x01, ioBase + ssrr);
-                goto exit;
+                cpld_bank_reset(bank_data);
+                return error ? error : -EIO;
         }
 
-        byte = 0x40 +new_data->portid;
-        reg = cmd;
-        outb(byte, ioBase + portid);
-        outb(reg,ioBase + cmdbyte0);
-        byte = 33;
-        outb(byte, ioBase + opcode);
-        addr = addr << 1;
-        addr |= 0x01;
-        outb(addr, ioBase + devaddr);
-        while ((inb(ioBase + ssrr) & 0x40))
-        {
-                udelay(100);
+        outb(0x40 + portid, bank->portid);
+        outb(cmd, bank->cmdbyte0);
+        outb(CPLD_OPCODE(len, cmd_len), bank->opcode);
+        /* Writing the device address starts the transaction */
+        outb(addr << 1 | 0x01, bank->devaddr);
+
+        error = cpld_wait_idle(bank_data);
+        if (error || (inb(bank->ssrr) & SSRR_ERROR)) {
+                /* Read error reset the port */
+                cpld_bank_reset(bank_data);
+                return error ? error : -EIO;
         }
 
-        if ((inb(ioBase + ssrr) & 0x80) == 0x80) {
-            /* Read error reset the port */
-                error = -EIO;
-                outb(0x00, ioBase + ssrr);
-                udelay(3000);
-                outb(0x01, ioBase + ssrr);
-                goto exit;
+        for (i = 0; i < len; i++)
+                buf[i] = inb(bank->readdata + i);
+
+        return 0;
+}
+
+/**
+ * Run one write transaction on a bridge bank. Caller holds the bank lock.
+ * @param  bank_data bridge bank of the port.
+ * @param  portid   port number, 1 based.
+ * @param  addr     7 bit device address.
+ * @param  cmd      command byte.
+ * @param  buf      data written after the command byte.
+ * @param  len      number of data bytes, up to CPLD_WRITE_MAX.
+ * @return          0 if not error, else the error code.
+ */
+static int cpld_i2c_write(struct dx010_bank_data *bank_data, int portid, u16 addr,
+                u8 cmd, const u8 *buf, int len)
+{
+        const struct dx010_bank *bank = bank_data->regs;
+        int error;
+        int i;
+
+        error = cpld_wait_idle(bank_data);
+        if (error || (inb(bank->ssrr) & SSRR_ERROR)) {
+                cpld_bank_reset(bank_data);
+                return error ? error : -EIO;
         }
 
-        temp = ioBase + readdata;
-        word_data = inb(temp);
-        word_data |= (inb(++temp) << 8);
+        outb(0x40 + portid, bank->portid);
+        outb(cmd, bank->cmdbyte0);
+        for (i = 0; i < len; i++)
+                outb(buf[i], bank->writedata + i);
+        outb(CPLD_OPCODE(0, 1 + len), bank->opcode);
+        /* Writing the device address starts the transaction */
+        outb(addr << 1, bank->devaddr);
+
+        error = cpld_wait_idle(bank_data);
+        if (error || (inb(bank->ssrr) & SSRR_ERROR)) {
+                /* Write error reset the port */
+                cpld_bank_reset(bank_data);
+                return error ? error : -EIO;
+        }
 
-        mutex_unlock(&cpld_data->cpld_lock);
-        data->word = word_data;
         return 0;
+}
 
-exit:
-        mutex_unlock(&cpld_data->cpld_lock);
-        return error;
+/**
+ * Port bitmap register holding a port, and the bit of the port in it.
+ * @param  portid   QSFP port number, 1 based.
+ * @return          the register group, or NULL for a port without one.
+ */
+static const struct dx010_port_reg *dx010_port_reg(int portid, int *bit)
+{
+        int i;
+
+        for (i = 0; i < ARRAY_SIZE(dx010_port_regs); i++) {
+                if (portid >= dx010_port_regs[i].first &&
+                                portid < dx010_port_regs[i].first + dx010_port_regs[i].count) {
+                        *bit = portid - dx010_port_regs[i].first;
+                        return &dx010_port_regs[i];
+                }
+        }
+        return NULL;
 }
 
-static int dx010_i2c_access(struct i2c_adapter *a, u16 addr,
-              unsigned short flags, char rw, u8 cmd,
-              int size, union i2c_smbus_data *data)
+static bool dx010_port_present(int portid)
+{
+        const struct dx010_port_reg *reg;
+        int bit;
+
+        reg = dx010_port_reg(portid, &bit);
+        return reg && !(inb(reg->abs) & BIT(bit));
+}
+
+/**
+ * Track the page select byte of a QSFP module after it was read or written.
+ * Caller holds the bank lock.
+ * @param  cmd      first byte offset of the transfer.
+ * @param  buf      bytes transferred.
+ * @param  len      number of bytes.
+ */
+static void dx010_page_seen(int portid, u16 addr, u8 cmd, const u8 *buf, int len)
 {
+        if (portid > PORT_BANK3_END || addr != QSFP_EEPROM_ADDR)
+                return;
+        if (cmd <= QSFP_PAGE_SELECT && cmd + len > QSFP_PAGE_SELECT)
+                cpld_data->page[portid - 1] = buf[QSFP_PAGE_SELECT - cmd];
+}
 
+/**
+ * Write eeprom of QSFP device.
+ * @param  a        i2c adapter.
+ * @param  addr     address to write.
+ * @param  new_data QSFP port number struct.
+ * @param  cmd      i2c command.
+ * @param  size     i2c transaction type.
+ * @return          0 if not error, else the error code.
+ *
+ * Selecting the QSFP page already selected is answered from the page
+ * cache, while the module stays present.
+ */
+static int i2c_write_eeprom(struct i2c_adapter *a, u16 addr,
+               struct dx010_i2c_data *new_data, u8 cmd, int size,
+               union i2c_smbus_data *data){
+
+        struct dx010_bank_data *bank_data;
+        int portid = new_data->portid;
+        u8 buf[2];
+        int len = 0, off, chunk;
         int error = 0;
 
-        struct dx010_i2c_data *new_data;
+        bank_data = dx010_port_bank(portid);
+        if (!bank_data)
+                return -EINVAL;
 
-        /* Write the command register */
-        new_data = i2c_get_adapdata(a);
+        mutex_lock(&bank_data->lock);
 
-        /* Map the size to what the chip understands */
         switch (size) {
-        case I2C_SMBUS_QUICK:
-                size = HST_CNTL2_QUICK;
-        break;
         case I2C_SMBUS_BYTE:
-                size = HST_CNTL2_BYTE;
-        break;
+                error = cpld_i2c_write(bank_data, portid, addr, cmd, NULL, 0);
+                break;
         case I2C_SMBUS_BYTE_DATA:
-                size = HST_CNTL2_BYTE_DATA;
-        break;
+                if (portid <= PORT_BANK3_END && addr == QSFP_EEPROM_ADDR &&
+                                cmd == QSFP_PAGE_SELECT) {
+                        if (!dx010_port_present(portid))
+                                cpld_data->page[portid - 1] = -1;
+                        else if (cpld_data->page[portid - 1] == data->byte)
+                                break;
+                }
+                error = cpld_i2c_write(bank_data, portid, addr, cmd, &data->byte, 1);
+                len = 1;
+                buf[0] = data->byte;
+                break;
         case I2C_SMBUS_WORD_DATA:
-            	size = HST_CNTL2_WORD_DATA;
-        break;
-        case I2C_SMBUS_BLOCK_DATA:
-                size = HST_CNTL2_BLOCK;
-        break;
+                buf[0] = data->word & 0xff;
+                buf[1] = data->word >> 8;
+                error = cpld_i2c_write(bank_data, portid, addr, cmd, buf, 2);
+                len = 2;
+                break;
+        case I2C_SMBUS_I2C_BLOCK_DATA:
+                if (data->block[0] < 1 || data->block[0] > I2C_SMBUS_BLOCK_MAX) {
+                        error = -EINVAL;
+                        break;
+                }
+                for (off = 0; off < data->block[0] && !error; off += chunk) {
+                        chunk = min(data->block[0] - off, CPLD_WRITE_MAX);
+                        error = cpld_i2c_write(bank_data, portid, addr, cmd + off,
+                                        &data->block[1 + off], chunk);
+                }
+                if (!error)
+                        dx010_page_seen(portid, addr, cmd, &data->block[1], data->block[0]);
+                break;
         default:
-                dev_warn(&a->dev, "Unsupported transaction %d\n", size);
                 error = -EOPNOTSUPP;
-                goto Done;
+                break;
         }
 
+        if (error && portid <= PORT_BANK3_END)
+                cpld_data->page[portid - 1] = -1;
+        else if (len)
+                dx010_page_seen(portid, addr, cmd, buf, len);
+
+        mutex_unlock(&bank_data->lock);
+        return error;
+}
+
+/**
+ * Read eeprom of QSFP device.
+ * @param  a        i2c adapter.
+ * @param  addr     address to read.
+ * @param  new_data QSFP port number struct.
+ * @param  cmd      i2c command.
+ * @param  size     i2c transaction type.
+ * @return          0 if not error, else the error code.
+ *
+ * An I2C block read is split in CPLD_READ_MAX byte transactions, all
+ * under one hold of the bank lock. Ports on different banks are read in
+ * parallel.
+ */
+static int i2c_read_eeprom(struct i2c_adapter *a, u16 addr,
+               struct dx010_i2c_data *new_data, u8 cmd, int size,
+               union i2c_smbus_data *data){
+
+        struct dx010_bank_data *bank_data;
+        u8 buf[2];
+        int len, off, chunk;
+        int error = 0;
+
+        bank_data = dx010_port_bank(new_data->portid);
+        if (!bank_data)
+                return -EINVAL;
+
+        mutex_lock(&bank_data->lock);
+
         switch (size) {
-        case HST_CNTL2_BYTE:    /* Result put in SMBHSTDAT0 */
-        break;
-        case HST_CNTL2_BYTE_DATA:
-        break;
-        case HST_CNTL2_WORD_DATA:
-                if( 0 == i2c_read_eeprom(a,addr,new_data,cmd,data)){
-                    error = 0;
-                }else{
-                    error = -EIO;
+        case I2C_SMBUS_BYTE:
+                error = cpld_i2c_read(bank_data, new_data->portid, addr, 0, 0, buf, 1);
+                data->byte = buf[0];
+                break;
+        case I2C_SMBUS_BYTE_DATA:
+                error = cpld_i2c_read(bank_data, new_data->portid, addr, cmd, 1, buf, 1);
+                data->byte = buf[0];
+                if (!error)
+                        dx010_page_seen(new_data->portid, addr, cmd, buf, 1);
+                break;
+        case I2C_SMBUS_WORD_DATA:
+                error = cpld_i2c_read(bank_data, new_data->portid, addr, cmd, 1, buf, 2);
+                data->word = buf[0] | buf[1] << 8;
+                break;
+        case I2C_SMBUS_I2C_BLOCK_DATA:
+                len = data->block[0];
+                if (len < 1 || len > I2C_SMBUS_BLOCK_MAX) {
+                        error = -EINVAL;
+                        break;
+                }
+                for (off = 0; off < len && !error; off += chunk) {
+                        chunk = min(len - off, CPLD_READ_MAX);
+                        error = cpld_i2c_read(bank_data, new_data->portid, addr,
+                                        cmd + off, 1, &data->block[1 + off], chunk);
                 }
-        break;
+                if (!error)
+                        dx010_page_seen(new_data->portid, addr, cmd, &data->block[1], len);
+                break;
+        default:
+                error = -EOPNOTSUPP;
+                break;
         }
 
-Done:
+        if (error && new_data->portid <= PORT_BANK3_END)
+                cpld_data->page[new_data->portid - 1] = -1;
+
+        mutex_unlock(&bank_data->lock);
         return error;
 }
 
+static int dx010_i2c_access(struct i2c_adapter *a, u16 addr,
+              unsigned short flags, char rw, u8 cmd,
+              int size, union i2c_smbus_data *data)
+{
+        struct dx010_i2c_data *new_data;
+
+        new_data = i2c_get_adapdata(a);
+
+        switch (size) {
+        case I2C_SMBUS_BYTE:
+        case I2C_SMBUS_BYTE_DATA:
+        case I2C_SMBUS_WORD_DATA:
+        case I2C_SMBUS_I2C_BLOCK_DATA:
+                if (rw == I2C_SMBUS_WRITE)
+                        return i2c_write_eeprom(a, addr, new_data, cmd, size, data);
+                return i2c_read_eeprom(a, addr, new_data, cmd, size, data);
+        default:
+                dev_warn(&a->dev, "Unsupported transaction %d\n", size);
+                return -EOPNOTSUPP;
+        }
+}
+
 static u32 dx010_i2c_func(struct i2c_adapter *a)
 {
-        return I2C_FUNC_SMBUS_QUICK | I2C_FUNC_SMBUS_BYTE |
-                        I2C_FUNC_SMBUS_BYTE_DATA | I2C_FUNC_SMBUS_WORD_DATA |
-                        I2C_FUNC_SMBUS_BLOCK_DATA;
+        return I2C_FUNC_SMBUS_BYTE | I2C_FUNC_SMBUS_BYTE_DATA |
+                        I2C_FUNC_SMBUS_WORD_DATA | I2C_FUNC_SMBUS_I2C_BLOCK;
 }
 
 static const struct i2c_algorithm dx010_i2c_algorithm = {
@@ -436,6 +1042,7 @@ static int cel_dx010_lpc_drv_probe(struct platform_device *pdev)
         struct resource *res;
         int ret =0;
         int portid_count;
+        int i;
 
         cpld_data = devm_kzalloc(&pdev->dev, sizeof(struct dx010_cpld_data),
                         GFP_KERNEL);
@@ -443,6 +1050,17 @@ static int cel_dx010_lpc_drv_probe(struct platform_device *pdev)
                 return -ENOMEM;
 
         mutex_init(&cpld_data->cpld_lock);
+        for (i = 0; i < DX010_BANKS; i++) {
+                cpld_data->bank[i].regs = &dx010_banks[i];
+                mutex_init(&cpld_data->bank[i].lock);
+        }
+        for (i = 0; i < PORT_BANK3_END; i++)
+                cpld_data->page[i] = -1;
+        cpld_data->dev = &pdev->dev;
+        cpld_data->sample_ms = PORT_SAMPLE_MS;
+        cpld_data->max_age_ms = PORT_MAX_AGE_MS;
+        seqlock_init(&cpld_data->bitmap_seq);
+        INIT_DELAYED_WORK(&cpld_data->sample_work, dx010_port_sample);
 
         res = platform_get_resource(pdev, IORESOURCE_IO, 0);
         if (unlikely(!res)) {
@@ -459,6 +1077,13 @@ static int cel_dx010_lpc_drv_probe(struct platform_device *pdev)
                 cpld_data->i2c_adapter[portid_count-1] =
                                 cel_dx010_i2c_init(pdev, portid_count);
 
+        /* Seed the bitmaps so the first sample only logs real changes */
+        mutex_lock(&cpld_data->cpld_lock);
+        dx010_port_refresh_locked(NULL);
+        mutex_unlock(&cpld_data->cpld_lock);
+        schedule_delayed_work(&cpld_data->sample_work,
+                        msecs_to_jiffies(cpld_data->sample_ms));
+
         return 0;
 }
 
@@ -468,6 +1093,7 @@ static int cel_dx010_lpc_drv_remove(struct platform_device *pdev)
         struct dx010_i2c_data *new_data;
 
         sysfs_remove_group(&pdev->dev.kobj, &dx010_lpc_attr_grp);
+        cancel_delayed_work_sync(&cpld_data->sample_work);
 
         for (portid_count=1 ; portid_count<=LENGTH_PORT_CPLD ; portid_count++)
                 i2c_del_adapter(cpld_data->i2c_adapter[portid_count-1]);
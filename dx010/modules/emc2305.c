@@ -43,6 +43,10 @@
 #include <linux/err.h>
 #include <linux/mutex.h>
 #include <linux/of.h>
+#include <linux/thermal.h>
+#include <linux/interrupt.h>
+#include <linux/workqueue.h>
+#include <linux/kobject.h>
 
 /*
  * Addresses scanned.
@@ -107,6 +111,35 @@ enum {
 
 #define SEL_FAN(fan, reg) (reg + fan * 0x10)
 
+/* Registers of one fan, REG_FAN_SETTING to REG_TACH_READ_LOW */
+#define FAN_REG_WINDOW 0x10
+
+/* Default time between whole chip refreshes, in ms */
+#define EMC2305_UPDATE_INTERVAL 1500
+
+/*
+ * Cooling states of the thermal cooling device, spread evenly over the PWM
+ * range above a floor that keeps the fans spinning.
+ */
+#define EMC2305_COOLING_STATES	10
+#define EMC2305_COOLING_PWM_MIN	102
+
+/* REG_CONFIGURATION: block the ALERT# pin */
+#define CONFIG_MASK_ALERT	0x80
+
+/* REG_FAN_STATUS summary bits */
+#define FAN_STATUS_DRIVE_FAIL	0x04
+#define FAN_STATUS_SPIN_FAIL	0x02
+#define FAN_STATUS_STALL	0x01
+
+/*
+ * Fan faults are read on ALERT#, as an interrupt or an SMBus alert. A faulty
+ * fan is masked from ALERT# and its status polled until it recovers. The
+ * status is polled all the time until ALERT# is known to be wired, that is
+ * without an irq and before the first SMBus alert.
+ */
+#define EMC2305_FAULT_POLL_MS	250
+
 /*
  * Factor by equations [2] and [3] from data sheet; valid for fans where the
  * number of edges equals (poles * 2 + 1).
@@ -116,8 +149,6 @@ enum {
 
 struct emc2305_fan_data {
 	bool		enabled;
-	bool		valid;
-	unsigned long	last_updated;
 	bool		rpm_control;
 	u8		multiplier;
 	u8		poles;
@@ -130,8 +161,21 @@ struct emc2305_fan_data {
 struct emc2305_data {
 	struct device		*hwmon_dev;
 	struct mutex		update_lock;
+	bool			valid;
+	unsigned long		last_updated;
+	unsigned int		update_interval;	/* in ms */
 	int			fans;
 	struct emc2305_fan_data	fan[5];
+	struct thermal_cooling_device	*cdev;
+	unsigned long		cooling_state;
+	struct i2c_client	*client;
+	int			irq;		/* ALERT# interrupt, 0 if none */
+	bool			smbus_alert;	/* An SMBus alert was received */
+	u8			int_enable;	/* Fans unmasked from ALERT# */
+	struct delayed_work	fault_work;
+	u8			stall;		/* Per fan bits */
+	u8			spin_fail;
+	u8			drive_fail;
 };
 
 static int read_u8_from_i2c(struct i2c_client *client, u8 i2c_reg, u8 *output)
@@ -210,25 +254,233 @@ static void read_fan_data(struct i2c_client *client, int fan_idx)
 			  SEL_FAN(fan_idx, REG_TACH_READ_LOW));
 }
 
+/*
+ * Read the register window of one fan with a single auto-increment block
+ * read. Returns false if the adapter or the transfer did not deliver the
+ * whole window.
+ */
+static bool read_fan_window(struct i2c_client *client, int fan_idx)
+{
+	struct emc2305_data *data = i2c_get_clientdata(client);
+	struct emc2305_fan_data *fan = &data->fan[fan_idx];
+	u8 regs[FAN_REG_WINDOW];
+	u8 conf1;
+	int status;
+
+	if (!i2c_check_functionality(client->adapter,
+				     I2C_FUNC_SMBUS_READ_I2C_BLOCK))
+		return false;
+
+	status = i2c_smbus_read_i2c_block_data(client,
+			SEL_FAN(fan_idx, REG_FAN_SETTING), sizeof(regs), regs);
+	if (status != sizeof(regs)) {
+		dev_dbg(&client->dev, "fan %d block read, err %d\n",
+			fan_idx + 1, status);
+		return false;
+	}
+
+#define FAN_REG(reg) regs[(reg) - REG_FAN_SETTING]
+	conf1 = FAN_REG(REG_FAN_CONFIGURATION_1);
+	fan->rpm_control = (conf1 & 0x80) != 0;
+	fan->multiplier = 1 << ((conf1 & 0x60) >> 5);
+	fan->poles = ((conf1 & 0x18) >> 3) + 1;
+	fan->target = ((u16)FAN_REG(REG_TACH_TARGET_HIGH) << 5) |
+		      (FAN_REG(REG_TACH_TARGET_LOW) >> 3);
+	fan->tach = ((u16)FAN_REG(REG_TACH_READ_HIGH) << 5) |
+		    (FAN_REG(REG_TACH_READ_LOW) >> 3);
+	fan->pwm = FAN_REG(REG_FAN_SETTING);
+#undef FAN_REG
+
+	return true;
+}
+
+/*
+ * Refresh all fans of the chip at once, at most every update_interval.
+ * The attributes are all served from this snapshot.
+ */
+static struct emc2305_data *emc2305_update_device(struct i2c_client *client)
+{
+	struct emc2305_data *data = i2c_get_clientdata(client);
+	int fan_idx;
+
+	mutex_lock(&data->update_lock);
+
+	if (time_after(jiffies, data->last_updated +
+		       msecs_to_jiffies(data->update_interval))
+	    || !data->valid) {
+		for (fan_idx = 0; fan_idx < data->fans; ++fan_idx) {
+			if (read_fan_window(client, fan_idx))
+				continue;
+			read_fan_config_from_i2c(client, fan_idx);
+			read_fan_data(client, fan_idx);
+			read_fan_setting(client, fan_idx);
+		}
+		data->valid = true;
+		data->last_updated = jiffies;
+	}
+
+	mutex_unlock(&data->update_lock);
+	return data;
+}
+
 static struct emc2305_fan_data *
 emc2305_update_fan(struct i2c_client *client, int fan_idx)
+{
+	return &emc2305_update_device(client)->fan[fan_idx];
+}
+
+/*
+ * fan fault handling
+ */
+
+static void emc2305_notify_fan(struct i2c_client *client, int fan_idx,
+			       bool fault, bool alarm)
+{
+	char name[16], fan[16], fault_env[16], alarm_env[16];
+	char *envp[] = { "EVENT=fan_fault", fan, fault_env, alarm_env, NULL };
+
+	snprintf(name, sizeof(name), "fan%d_fault", fan_idx + 1);
+	sysfs_notify(&client->dev.kobj, NULL, name);
+	snprintf(name, sizeof(name), "fan%d_alarm", fan_idx + 1);
+	sysfs_notify(&client->dev.kobj, NULL, name);
+
+	snprintf(fan, sizeof(fan), "FAN=%d", fan_idx + 1);
+	snprintf(fault_env, sizeof(fault_env), "FAULT=%d", fault);
+	snprintf(alarm_env, sizeof(alarm_env), "ALARM=%d", alarm);
+	kobject_uevent_env(&client->dev.kobj, KOBJ_CHANGE, envp);
+}
+
+/* Per fan bits of the enabled fans, unused channels never raise faults */
+static u8 emc2305_fan_mask(struct emc2305_data *data)
+{
+	u8 mask = 0;
+	int fan_idx;
+
+	for (fan_idx = 0; fan_idx < data->fans; ++fan_idx) {
+		if (data->fan[fan_idx].enabled)
+			mask |= BIT(fan_idx);
+	}
+	return mask;
+}
+
+/*
+ * Read the fault status registers, which clear on read once the condition
+ * is gone, and report fans whose fault or alarm changed. A register that
+ * cannot be read keeps its last value. Faulty fans are masked from ALERT#,
+ * which a persistent fault would otherwise hold asserted, and unmasked once
+ * they recover. Returns true while any fan is still faulty.
+ */
+static bool emc2305_check_faults(struct i2c_client *client)
 {
 	struct emc2305_data *data = i2c_get_clientdata(client);
-	struct emc2305_fan_data *fan_data = &data->fan[fan_idx];
+	u8 status, stall = 0, spin_fail = 0, drive_fail = 0;
+	u8 old_fault, old_alarm, fault, alarm, int_enable;
+	u8 mask = emc2305_fan_mask(data);
+	int fan_idx;
 
 	mutex_lock(&data->update_lock);
 
-	if (time_after(jiffies, fan_data->last_updated + HZ + HZ / 2)
-	    || !fan_data->valid) {
-		read_fan_config_from_i2c(client, fan_idx);
-		read_fan_data(client, fan_idx);
-		read_fan_setting(client, fan_idx);
-		fan_data->valid = true;
-		fan_data->last_updated = jiffies;
+	old_fault = data->stall | data->spin_fail;
+	old_alarm = old_fault | data->drive_fail;
+	if (read_u8_from_i2c(client, REG_FAN_STATUS, &status) < 0) {
+		mutex_unlock(&data->update_lock);
+		return old_alarm != 0;
+	}
+	if (status & FAN_STATUS_STALL) {
+		stall = data->stall;
+		read_u8_from_i2c(client, REG_FAN_STALL_STATUS, &stall);
+	}
+	if (status & FAN_STATUS_SPIN_FAIL) {
+		spin_fail = data->spin_fail;
+		read_u8_from_i2c(client, REG_FAN_SPIN_STATUS, &spin_fail);
+	}
+	if (status & FAN_STATUS_DRIVE_FAIL) {
+		drive_fail = data->drive_fail;
+		read_u8_from_i2c(client, REG_DRIVE_FAIL_STATUS, &drive_fail);
 	}
 
+	data->stall = stall & mask;
+	data->spin_fail = spin_fail & mask;
+	data->drive_fail = drive_fail & mask;
+	fault = data->stall | data->spin_fail;
+	alarm = fault | data->drive_fail;
+
+	int_enable = mask & ~alarm;
+	if (int_enable != data->int_enable &&
+	    i2c_smbus_write_byte_data(client, REG_FAN_INTERRUPT_ENABLE,
+				      int_enable) >= 0)
+		data->int_enable = int_enable;
+
 	mutex_unlock(&data->update_lock);
-	return fan_data;
+
+	for (fan_idx = 0; fan_idx < data->fans; ++fan_idx) {
+		if (!((fault ^ old_fault) & BIT(fan_idx)) &&
+		    !((alarm ^ old_alarm) & BIT(fan_idx)))
+			continue;
+		dev_warn(&client->dev, "fan%d %s\n", fan_idx + 1,
+			 alarm & BIT(fan_idx) ? "failed" : "recovered");
+		emc2305_notify_fan(client, fan_idx, fault & BIT(fan_idx),
+				   alarm & BIT(fan_idx));
+	}
+
+	return alarm != 0;
+}
+
+static void emc2305_fault_work(struct work_struct *work)
+{
+	struct emc2305_data *data = container_of(to_delayed_work(work),
+						 struct emc2305_data,
+						 fault_work);
+	struct i2c_client *client = data->client;
+
+	if (emc2305_check_faults(client) ||
+	    !(data->irq || data->smbus_alert))
+		schedule_delayed_work(&data->fault_work,
+				      msecs_to_jiffies(EMC2305_FAULT_POLL_MS));
+}
+
+static irqreturn_t emc2305_irq(int irq, void *dev_id)
+{
+	struct emc2305_data *data = dev_id;
+
+	if (emc2305_check_faults(data->client))
+		mod_delayed_work(system_wq, &data->fault_work,
+				 msecs_to_jiffies(EMC2305_FAULT_POLL_MS));
+
+	return IRQ_HANDLED;
+}
+
+/* SMBus alert, when ALERT# is wired to the adapter rather than an irq */
+static void emc2305_alert(struct i2c_client *client, unsigned int flag)
+{
+	struct emc2305_data *data = i2c_get_clientdata(client);
+
+	data->smbus_alert = true;
+	mod_delayed_work(system_wq, &data->fault_work, 0);
+}
+
+/* Let the chip assert ALERT# on stall, spin up and drive fail of enabled fans */
+static int emc2305_enable_alert(struct i2c_client *client)
+{
+	struct emc2305_data *data = i2c_get_clientdata(client);
+	u8 mask = emc2305_fan_mask(data);
+	u8 conf;
+	int status;
+
+	status = i2c_smbus_write_byte_data(client, REG_FAN_INTERRUPT_ENABLE,
+					   mask);
+	if (status < 0)
+		return status;
+	data->int_enable = mask;
+
+	status = read_u8_from_i2c(client, REG_CONFIGURATION, &conf);
+	if (status < 0)
+		return status;
+	if (!(conf & CONFIG_MASK_ALERT))
+		return 0;
+
+	return i2c_smbus_write_byte_data(client, REG_CONFIGURATION,
+					 conf & ~CONFIG_MASK_ALERT);
 }
 
 static struct emc2305_fan_data *
@@ -307,7 +559,7 @@ emc2305_set_fan_div(struct i2c_client *client, int fan_idx, long new_div)
 
 exit_invalidate:
 	/* invalidate fan data to force re-read from hardware */
-	fan->valid = false;
+	data->valid = false;
 exit_unlock:
 	mutex_unlock(&data->update_lock);
 	return status;
@@ -398,15 +650,88 @@ emc2305_set_pwm(struct i2c_client *client, int fan_idx, long pwm)
 	if ((pwm < 0) || (pwm > 255))
 		return -EINVAL;
 
+	mutex_lock(&data->update_lock);
+
 	fan->pwm = pwm;
+	status = i2c_smbus_write_byte_data(client, reg_fan_setting, fan->pwm);
+
+	mutex_unlock(&data->update_lock);
+	return status;
+}
+
+/*
+ * thermal cooling device
+ *
+ * The thermal zones of the board sensors bind to this device by its
+ * "emc2305" type. A state sets the PWM of every enabled fan that is not
+ * under RPM control; fans under RPM control keep their tach target.
+ *
+ * The state and the PWM writes are made under update_lock, so they do not
+ * interleave with a pwmN write. A manual pwmN value is only kept until the
+ * bound thermal zone next changes the state; set the fan to RPM control
+ * (pwmN_enable 3) to keep it out of the cooling device.
+ */
+
+static int emc2305_get_max_state(struct thermal_cooling_device *cdev,
+				 unsigned long *state)
+{
+	*state = EMC2305_COOLING_STATES;
+	return 0;
+}
+
+static int emc2305_get_cur_state(struct thermal_cooling_device *cdev,
+				 unsigned long *state)
+{
+	struct i2c_client *client = cdev->devdata;
+	struct emc2305_data *data = i2c_get_clientdata(client);
+
+	*state = data->cooling_state;
+	return 0;
+}
+
+static int emc2305_set_cur_state(struct thermal_cooling_device *cdev,
+				 unsigned long state)
+{
+	struct i2c_client *client = cdev->devdata;
+	struct emc2305_data *data = i2c_get_clientdata(client);
+	long pwm;
+	int fan_idx;
+	int status;
+
+	if (state > EMC2305_COOLING_STATES)
+		return -EINVAL;
+
+	pwm = EMC2305_COOLING_PWM_MIN +
+	      (255 - EMC2305_COOLING_PWM_MIN) * state / EMC2305_COOLING_STATES;
+
+	emc2305_update_device(client);
 
 	mutex_lock(&data->update_lock);
+	for (fan_idx = 0; fan_idx < data->fans; ++fan_idx) {
+		struct emc2305_fan_data *fan = &data->fan[fan_idx];
 
-	status = i2c_smbus_write_byte_data(client, reg_fan_setting, fan->pwm);
+		if (!fan->enabled || fan->rpm_control)
+			continue;
+		status = i2c_smbus_write_byte_data(client,
+				SEL_FAN(fan_idx, REG_FAN_SETTING), pwm);
+		if (status < 0)
+			goto unlock;
+		fan->pwm = pwm;
+	}
+	data->cooling_state = state;
+	status = 0;
 
+unlock:
 	mutex_unlock(&data->update_lock);
 	return status;
 }
+
+static const struct thermal_cooling_device_ops emc2305_cooling_ops = {
+	.get_max_state = emc2305_get_max_state,
+	.get_cur_state = emc2305_get_cur_state,
+	.set_cur_state = emc2305_set_cur_state,
+};
+
 /*
  * sysfs callback functions
  *
@@ -435,8 +760,11 @@ show_fan_input(struct device *dev, struct device_attribute *da, char *buf)
 static ssize_t
 show_fan_fault(struct device *dev, struct device_attribute *da, char *buf)
 {
+	struct emc2305_data *data = i2c_get_clientdata(to_i2c_client(dev));
 	struct emc2305_fan_data *fan = emc2305_update_device_fan(dev, da);
-	bool fault = ((fan->tach & 0x1fe0) == 0x1fe0);
+	u8 mask = BIT(to_sensor_dev_attr(da)->index);
+	bool fault = ((fan->tach & 0x1fe0) == 0x1fe0) ||
+		     ((data->stall | data->spin_fail) & mask);
 	return sprintf(buf, "%d\n", fault ? 1 : 0);
 }
 
@@ -451,8 +779,11 @@ show_fan_div(struct device *dev, struct device_attribute *da, char *buf)
 static ssize_t
 show_fan_alarm(struct device *dev, struct device_attribute *da, char *buf)
 {
+	struct emc2305_data *data = i2c_get_clientdata(to_i2c_client(dev));
 	struct emc2305_fan_data *fan = emc2305_update_device_fan(dev, da);
-	bool fault = ((fan->tach & 0x1fe0) == 0x1fe0);
+	u8 mask = BIT(to_sensor_dev_attr(da)->index);
+	bool fault = ((fan->tach & 0x1fe0) == 0x1fe0) ||
+		     ((data->stall | data->spin_fail | data->drive_fail) & mask);
 	return sprintf(buf, "%d\n", fault ? 1 : 0);
 }
 
@@ -557,6 +888,33 @@ static ssize_t set_pwm(struct device *dev, struct device_attribute *da,
 	return count;
 }
 
+static ssize_t
+show_update_interval(struct device *dev, struct device_attribute *da, char *buf)
+{
+	struct emc2305_data *data = i2c_get_clientdata(to_i2c_client(dev));
+
+	return sprintf(buf, "%u\n", data->update_interval);
+}
+
+static ssize_t
+set_update_interval(struct device *dev, struct device_attribute *da,
+		    const char *buf, size_t count)
+{
+	struct emc2305_data *data = i2c_get_clientdata(to_i2c_client(dev));
+	unsigned long val;
+	int ret;
+
+	ret = kstrtoul(buf, 10, &val);
+	if (ret)
+		return ret;
+
+	mutex_lock(&data->update_lock);
+	data->update_interval = clamp_val(val, 0, 60000);
+	mutex_unlock(&data->update_lock);
+
+	return count;
+}
+
 /* define a read only attribute */
 #define EMC2305_ATTR_RO(_type, _item, _num)			\
 	SENSOR_ATTR(_type ## _num ## _ ## _item, S_IRUGO,	\
@@ -595,6 +953,8 @@ static ssize_t set_pwm(struct device *dev, struct device_attribute *da,
 
 /* common attributes for EMC2303 and EMC2305 */
 static const struct sensor_device_attribute emc2305_attr_common[] = {
+	SENSOR_ATTR(update_interval, S_IRUGO | S_IWUSR,
+		    show_update_interval, set_update_interval, 0),
 };
 
 /* fan attributes for the single fans */
@@ -623,6 +983,11 @@ static int emc2305_remove(struct i2c_client *client)
 	struct emc2305_data *data = i2c_get_clientdata(client);
 	int fan_idx, i;
 
+	if (data->irq)
+		free_irq(data->irq, data);
+	cancel_delayed_work_sync(&data->fault_work);
+	if (data->cdev)
+		thermal_cooling_device_unregister(data->cdev);
 	hwmon_device_unregister(data->hwmon_dev);
 
 	for (fan_idx = 0; fan_idx < data->fans; ++fan_idx)
@@ -752,6 +1117,9 @@ emc2305_probe(struct i2c_client *client, const struct i2c_device_id *id)
 
 	i2c_set_clientdata(client, data);
 	mutex_init(&data->update_lock);
+	data->update_interval = EMC2305_UPDATE_INTERVAL;
+	data->client = client;
+	INIT_DELAYED_WORK(&data->fault_work, emc2305_fault_work);
 
 	status = i2c_smbus_read_byte_data(client, REG_PRODUCT_ID);
 	switch (status) {
@@ -798,6 +1166,29 @@ emc2305_probe(struct i2c_client *client, const struct i2c_device_id *id)
 		goto exit_remove_fans;
 	}
 
+	data->cdev = thermal_cooling_device_register("emc2305", client,
+						     &emc2305_cooling_ops);
+	if (IS_ERR(data->cdev)) {
+		dev_warn(&client->dev, "no cooling device, err %ld\n",
+			 PTR_ERR(data->cdev));
+		data->cdev = NULL;
+	}
+
+	status = emc2305_enable_alert(client);
+	if (status < 0)
+		dev_warn(&client->dev, "cannot enable ALERT#, err %d\n",
+			 status);
+	if (client->irq > 0) {
+		status = request_threaded_irq(client->irq, NULL, emc2305_irq,
+					      IRQF_ONESHOT, "emc2305", data);
+		if (status)
+			dev_warn(&client->dev, "irq %d unavailable, err %d\n",
+				 client->irq, status);
+		else
+			data->irq = client->irq;
+	}
+	schedule_delayed_work(&data->fault_work, 0);
+
 	dev_info(&client->dev, "%s: sensor '%s'\n",
 		 dev_name(data->hwmon_dev), client->name);
 
@@ -872,6 +1263,7 @@ static struct i2c_driver emc2305_driver = {
 	},
 	.probe		= emc2305_probe,
 	.remove		= emc2305_remove,
+	.alert		= emc2305_alert,
 	.id_table	= emc2305_id,
 /*
 	.detect		= emc2305_detect,
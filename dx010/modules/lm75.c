@@ -64,6 +64,15 @@ static const unsigned short normal_i2c[] = { 0x48, 0x49, 0x4a, 0x4b, 0x4c,
 					0x4d, 0x4e, 0x4f, I2C_CLIENT_END };
 
 
+/*
+ * Thermal zone registered when there is no device tree zone. It has one
+ * active trip, bound to the emc2305 fan cooling devices.
+ */
+#define LM75_TRIP_TEMP		50000	/* mC */
+#define LM75_TRIP_HYST		2000	/* mC */
+#define LM75_POLLING_DELAY	1000	/* ms */
+#define LM75_COOLING_TYPE	"emc2305"
+
 /* The LM75 registers */
 #define LM75_REG_CONF		0x01
 static const u8 LM75_REG_TEMP[3] = {
@@ -77,6 +86,9 @@ struct lm75_data {
 	struct i2c_client	*client;
 	struct device		*hwmon_dev;
 	struct thermal_zone_device	*tz;
+	struct thermal_zone_device	*zone;	/* Without device tree */
+	int			trip_temp;	/* mC */
+	int			trip_hyst;	/* mC */
 	struct mutex		update_lock;
 	u8			orig_conf;
 	u8			resolution;	/* In bits, between 9 and 12 */
@@ -116,6 +128,90 @@ static int lm75_read_temp(void *dev, long *temp)
 	return 0;
 }
 
+/* thermal zone without device tree, 3.16 zone ops take unsigned mC */
+
+static int lm75_tz_get_temp(struct thermal_zone_device *tz,
+			    unsigned long *temp)
+{
+	long val;
+	int err;
+
+	err = lm75_read_temp(tz->devdata, &val);
+	if (err)
+		return err;
+
+	*temp = max(val, 0L);
+	return 0;
+}
+
+static int lm75_tz_get_trip_type(struct thermal_zone_device *tz, int trip,
+				 enum thermal_trip_type *type)
+{
+	*type = THERMAL_TRIP_ACTIVE;
+	return 0;
+}
+
+static int lm75_tz_get_trip_temp(struct thermal_zone_device *tz, int trip,
+				 unsigned long *temp)
+{
+	struct lm75_data *data = dev_get_drvdata(tz->devdata);
+
+	*temp = data->trip_temp;
+	return 0;
+}
+
+static int lm75_tz_set_trip_temp(struct thermal_zone_device *tz, int trip,
+				 unsigned long temp)
+{
+	struct lm75_data *data = dev_get_drvdata(tz->devdata);
+
+	data->trip_temp = min_t(unsigned long, temp, LM75_TEMP_MAX);
+	return 0;
+}
+
+static int lm75_tz_get_trip_hyst(struct thermal_zone_device *tz, int trip,
+				 unsigned long *hyst)
+{
+	struct lm75_data *data = dev_get_drvdata(tz->devdata);
+
+	*hyst = data->trip_hyst;
+	return 0;
+}
+
+static int lm75_tz_bind(struct thermal_zone_device *tz,
+			struct thermal_cooling_device *cdev)
+{
+	if (strcmp(cdev->type, LM75_COOLING_TYPE))
+		return 0;
+
+	return thermal_zone_bind_cooling_device(tz, 0, cdev,
+						THERMAL_NO_LIMIT,
+						THERMAL_NO_LIMIT);
+}
+
+static int lm75_tz_unbind(struct thermal_zone_device *tz,
+			  struct thermal_cooling_device *cdev)
+{
+	if (strcmp(cdev->type, LM75_COOLING_TYPE))
+		return 0;
+
+	return thermal_zone_unbind_cooling_device(tz, 0, cdev);
+}
+
+static struct thermal_zone_device_ops lm75_tz_ops = {
+	.bind = lm75_tz_bind,
+	.unbind = lm75_tz_unbind,
+	.get_temp = lm75_tz_get_temp,
+	.get_trip_type = lm75_tz_get_trip_type,
+	.get_trip_temp = lm75_tz_get_trip_temp,
+	.set_trip_temp = lm75_tz_set_trip_temp,
+	.get_trip_hyst = lm75_tz_get_trip_hyst,
+};
+
+static struct thermal_zone_params lm75_tz_params = {
+	.governor_name = "step_wise",
+};
+
 static ssize_t show_temp(struct device *dev, struct device_attribute *da,
 			 char *buf)
 {
@@ -303,6 +399,22 @@ lm75_probe(struct i2c_client *client, const struct i2c_device_id *id)
 	if (IS_ERR(data->tz))
 		data->tz = NULL;
 
+	if (!data->tz) {
+		data->trip_temp = LM75_TRIP_TEMP;
+		data->trip_hyst = LM75_TRIP_HYST;
+		/* trip 0 temperature writable through trip_point_0_temp */
+		data->zone = thermal_zone_device_register("lm75", 1, 0x1,
+							  data->hwmon_dev,
+							  &lm75_tz_ops,
+							  &lm75_tz_params, 0,
+							  LM75_POLLING_DELAY);
+		if (IS_ERR(data->zone)) {
+			dev_warn(dev, "no thermal zone, err %ld\n",
+				 PTR_ERR(data->zone));
+			data->zone = NULL;
+		}
+	}
+
 	dev_info(dev, "%s: sensor '%s'\n",
 		 dev_name(data->hwmon_dev), client->name);
 
@@ -313,6 +425,8 @@ static int lm75_remove(struct i2c_client *client)
 {
 	struct lm75_data *data = i2c_get_clientdata(client);
 
+	if (data->zone)
+		thermal_zone_device_unregister(data->zone);
 	thermal_zone_of_sensor_unregister(data->hwmon_dev, data->tz);
 	hwmon_device_unregister(data->hwmon_dev);
 	lm75_write_value(client, LM75_REG_CONF, data->orig_conf);
@@ -0,0 +1,163 @@
+/*
+ * questone2_topology.c - seastone2/questone2 Switch board FPGA/CPLD topology.
+ *
+ * Author: Pradchaya Phucharoen
+ *
+ * Copyright (C) 2017 Celestica Corp.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *   /
+ *   \--sys
+ *       \--devices
+ *            \--platform
+ *                \--seastone2 (questone2)
+ *                    |--FPGA
+ *                    |--CPLD1
+ *                    |--CPLD2
+ *                    \--SFF
+ *                        |--QSFP[1..32] (QSFP[1..8])
+ *                        \--SFP[1]      (SFP[1..48])
+ *
+ */
+
+#ifndef TEST_MODE
+#define MOD_VERSION "1.1.3"
+#else
+#define MOD_VERSION "TEST"
+#endif
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+
+#include "fpga_switchboard.h"
+
+#ifdef SEASTONE2
+#define VIRTUAL_I2C_QSFP_PORT           32
+#define VIRTUAL_I2C_SFP_PORT            1
+#else
+#define VIRTUAL_I2C_SFP_PORT            48
+#define VIRTUAL_I2C_QSFP_PORT           8
+#endif
+
+#define SFF_PORT_TOTAL    VIRTUAL_I2C_QSFP_PORT+VIRTUAL_I2C_SFP_PORT
+
+#define VIRTUAL_I2C_BUS_OFFSET  2
+
+#ifdef SEASTONE2
+/* PREDEFINED I2C SWITCH DEVICE TOPOLOGY */
+static const struct i2c_switch fpga_i2c_bus_dev[] = {
+    /* BUS2 QSFP Exported as virtual bus */
+    {I2C_MASTER_CH_2,0x72,0,QSFP,"QSFP1"}, {I2C_MASTER_CH_2,0x72,1,QSFP,"QSFP2"}, {I2C_MASTER_CH_2,0x72,2,QSFP,"QSFP3"}, {I2C_MASTER_CH_2,0x72,3,QSFP,"QSFP4"},
+    {I2C_MASTER_CH_2,0x72,4,QSFP,"QSFP5"}, {I2C_MASTER_CH_2,0x72,5,QSFP,"QSFP6"}, {I2C_MASTER_CH_2,0x72,6,QSFP,"QSFP7"}, {I2C_MASTER_CH_2,0x72,7,QSFP,"QSFP8"},
+    {I2C_MASTER_CH_2,0x73,0,QSFP,"QSFP9"}, {I2C_MASTER_CH_2,0x73,1,QSFP,"QSFP10"},{I2C_MASTER_CH_2,0x73,2,QSFP,"QSFP11"},{I2C_MASTER_CH_2,0x73,3,QSFP,"QSFP12"},
+    {I2C_MASTER_CH_2,0x73,4,QSFP,"QSFP13"},{I2C_MASTER_CH_2,0x73,5,QSFP,"QSFP14"},{I2C_MASTER_CH_2,0x73,6,QSFP,"QSFP15"},{I2C_MASTER_CH_2,0x73,7,QSFP,"QSFP16"},
+    {I2C_MASTER_CH_2,0x74,0,QSFP,"QSFP17"},{I2C_MASTER_CH_2,0x74,1,QSFP,"QSFP18"},{I2C_MASTER_CH_2,0x74,2,QSFP,"QSFP19"},{I2C_MASTER_CH_2,0x74,3,QSFP,"QSFP20"},
+    {I2C_MASTER_CH_2,0x74,4,QSFP,"QSFP21"},{I2C_MASTER_CH_2,0x74,5,QSFP,"QSFP22"},{I2C_MASTER_CH_2,0x74,6,QSFP,"QSFP23"},{I2C_MASTER_CH_2,0x74,7,QSFP,"QSFP24"},
+    {I2C_MASTER_CH_2,0x75,0,QSFP,"QSFP25"},{I2C_MASTER_CH_2,0x75,1,QSFP,"QSFP26"},{I2C_MASTER_CH_2,0x75,2,QSFP,"QSFP27"},{I2C_MASTER_CH_2,0x75,3,QSFP,"QSFP28"},
+    {I2C_MASTER_CH_2,0x75,4,QSFP,"QSFP29"},{I2C_MASTER_CH_2,0x75,5,QSFP,"QSFP30"},{I2C_MASTER_CH_2,0x75,6,QSFP,"QSFP31"},{I2C_MASTER_CH_2,0x75,7,QSFP,"QSFP32"},
+    /* BUS1 SFP+ Exported as virtual bus */
+    {I2C_MASTER_CH_1,0x72,0,SFP,"SFP1"},
+    /* BUS3 CPLD Access via SYSFS */
+    {I2C_MASTER_CH_3,0xFF,0,NONE,"CPLD"},
+    /* BUS5 POWER CHIP Exported as virtual bus */
+    {I2C_MASTER_CH_5,0xFF,0,NONE,"POWER"},
+    /* BUS4 CPLD_B */
+    {I2C_MASTER_CH_4,0xFF,0,NONE,"CPLD_B"},
+    /* BUS6 PSU */
+    {I2C_MASTER_CH_6,0xFF,0,NONE,"PSU"},
+    /* BUS7 FAN */
+    /* Channel 2 is no hardware connected */
+    {I2C_MASTER_CH_7,0x77,0,NONE,"FAN5"},{I2C_MASTER_CH_7,0x77,1,NONE,"FAN4"},{I2C_MASTER_CH_7,0x77,3,NONE,"FAN2"},{I2C_MASTER_CH_7,0x77,4,NONE,"FAN1"},
+    /* BUS8 POWER MONITOR */
+    {I2C_MASTER_CH_8,0xFF,0,NONE,"UCD90120"},
+    /* BUS9 LM75 */
+    {I2C_MASTER_CH_9,0xFF,0,NONE,"LM75"},
+};
+#else
+/* PREDEFINED I2C SWITCH DEVICE TOPOLOGY */
+static const struct i2c_switch fpga_i2c_bus_dev[] = {
+    /* BUS1 SFP Exported as virtual bus */
+    {I2C_MASTER_CH_10,0x72,0,SFP,"SFP1"}, {I2C_MASTER_CH_10,0x72,1,SFP,"SFP2"}, {I2C_MASTER_CH_10,0x72,2,SFP,"SFP3"}, {I2C_MASTER_CH_10,0x72,3,SFP,"SFP4"},
+    {I2C_MASTER_CH_10,0x72,4,SFP,"SFP5"}, {I2C_MASTER_CH_10,0x72,5,SFP,"SFP6"}, {I2C_MASTER_CH_10,0x72,6,SFP,"SFP7"}, {I2C_MASTER_CH_10,0x72,7,SFP,"SFP8"},
+    {I2C_MASTER_CH_10,0x73,0,SFP,"SFP9"}, {I2C_MASTER_CH_10,0x73,1,SFP,"SFP10"},{I2C_MASTER_CH_10,0x73,2,SFP,"SFP11"},{I2C_MASTER_CH_10,0x73,3,SFP,"SFP12"},
+    {I2C_MASTER_CH_10,0x73,4,SFP,"SFP13"},{I2C_MASTER_CH_10,0x73,5,SFP,"SFP14"},{I2C_MASTER_CH_10,0x73,6,SFP,"SFP15"},{I2C_MASTER_CH_10,0x73,7,SFP,"SFP16"},
+    {I2C_MASTER_CH_10,0x74,0,SFP,"SFP17"},{I2C_MASTER_CH_10,0x74,1,SFP,"SFP18"},{I2C_MASTER_CH_10,0x74,2,SFP,"SFP19"},{I2C_MASTER_CH_10,0x74,3,SFP,"SFP20"},
+    {I2C_MASTER_CH_10,0x74,4,SFP,"SFP21"},{I2C_MASTER_CH_10,0x74,5,SFP,"SFP22"},{I2C_MASTER_CH_10,0x74,6,SFP,"SFP23"},{I2C_MASTER_CH_10,0x74,7,SFP,"SFP24"},
+    {I2C_MASTER_CH_10,0x75,0,SFP,"SFP25"},{I2C_MASTER_CH_10,0x75,1,SFP,"SFP26"},{I2C_MASTER_CH_10,0x75,2,SFP,"SFP27"},{I2C_MASTER_CH_10,0x75,3,SFP,"SFP28"},
+    {I2C_MASTER_CH_10,0x75,4,SFP,"SFP29"},{I2C_MASTER_CH_10,0x75,5,SFP,"SFP30"},{I2C_MASTER_CH_10,0x75,6,SFP,"SFP31"},{I2C_MASTER_CH_10,0x75,7,SFP,"SFP32"},
+    {I2C_MASTER_CH_10,0x76,0,SFP,"SFP33"},{I2C_MASTER_CH_10,0x76,1,SFP,"SFP34"},{I2C_MASTER_CH_10,0x76,2,SFP,"SFP35"},{I2C_MASTER_CH_10,0x76,3,SFP,"SFP36"},
+    {I2C_MASTER_CH_10,0x76,4,SFP,"SFP37"},{I2C_MASTER_CH_10,0x76,5,SFP,"SFP38"},{I2C_MASTER_CH_10,0x76,6,SFP,"SFP39"},{I2C_MASTER_CH_10,0x76,7,SFP,"SFP40"},
+    {I2C_MASTER_CH_10,0x77,0,SFP,"SFP41"},{I2C_MASTER_CH_10,0x77,1,SFP,"SFP42"},{I2C_MASTER_CH_10,0x77,2,SFP,"SFP43"},{I2C_MASTER_CH_10,0x77,3,SFP,"SFP44"},
+    {I2C_MASTER_CH_10,0x77,4,SFP,"SFP45"},{I2C_MASTER_CH_10,0x77,5,SFP,"SFP46"},{I2C_MASTER_CH_10,0x77,6,SFP,"SFP47"},{I2C_MASTER_CH_10,0x77,7,SFP,"SFP48"},
+    /* BUS2 QSFP28 Exported as virtual bus */
+    {I2C_MASTER_CH_2,0x74,4,QSFP,"QSFP1"},{I2C_MASTER_CH_2,0x74,5,QSFP,"QSFP2"},{I2C_MASTER_CH_2,0x74,6,QSFP,"QSFP3"},{I2C_MASTER_CH_2,0x74,7,QSFP,"QSFP4"},
+    {I2C_MASTER_CH_2,0x74,0,QSFP,"QSFP5"},{I2C_MASTER_CH_2,0x74,1,QSFP,"QSFP6"},{I2C_MASTER_CH_2,0x74,2,QSFP,"QSFP7"},{I2C_MASTER_CH_2,0x74,3,QSFP,"QSFP8"},
+    /* BUS3 CPLD Access via SYSFS */
+    {I2C_MASTER_CH_3,0xFF,0,NONE,"CPLD"},
+    /* BUS5 POWER CHIP Exported as virtual bus */
+    {I2C_MASTER_CH_5,0xFF,0,NONE,"POWER"},
+    /* BUS4 CPLD_B */
+    {I2C_MASTER_CH_4,0xFF,0,NONE,"CPLD_B"},
+    /* BUS6 PSU */
+    {I2C_MASTER_CH_6,0xFF,0,NONE,"PSU"},
+    /* BUS7 FAN */
+    /* Channel 2 is no hardware connected */
+    {I2C_MASTER_CH_7,0x77,0,NONE,"FAN5"},{I2C_MASTER_CH_7,0x77,1,NONE,"FAN4"},{I2C_MASTER_CH_7,0x77,3,NONE,"FAN2"},{I2C_MASTER_CH_7,0x77,4,NONE,"FAN1"},
+    /* BUS8 UCD90120 */
+    {I2C_MASTER_CH_8,0xFF,0,NONE,"UCD90120"},
+    /* BUS9 TEMP SENSOR LM75 */
+    {I2C_MASTER_CH_9,0xFF,0,NONE,"LM75"}
+};
+#endif
+
+/* CPLD_LED_COLOR encoding, 2 bits */
+static const char *const questone2_led_colors[] = {
+    "both", "amber", "green", "off",
+};
+
+static const struct fpga_switchboard_topology questone2_topology = {
+#ifdef SEASTONE2
+    .driver_name = "seastone2",
+    .class_name = "seastone2_fpga",
+    .pci_name = "Seastone2_fpga_pci",
+#else
+    .driver_name = "questone2",
+    .class_name = "questone2_fpga",
+    .pci_name = "questone2_fpga_pci",
+#endif
+    .i2c_masters = I2C_MASTER_CH_10,
+    .bus_offset = VIRTUAL_I2C_BUS_OFFSET,
+    .buses = fpga_i2c_bus_dev,
+    .n_buses = ARRAY_SIZE(fpga_i2c_bus_dev),
+    .sff_ports = SFF_PORT_TOTAL,
+    .cpld_bus = SFF_PORT_TOTAL,
+    .led_colors = questone2_led_colors,
+    .n_led_colors = ARRAY_SIZE(questone2_led_colors),
+};
+
+static int __init questone2_init(void)
+{
+    return fpga_switchboard_init(&questone2_topology);
+}
+
+static void __exit questone2_exit(void)
+{
+    fpga_switchboard_exit();
+}
+
+module_init(questone2_init);
+module_exit(questone2_exit);
+
+MODULE_AUTHOR("Pradchaya P. pphuhcar@celestica.com");
+#ifdef SEASTONE2
+MODULE_DESCRIPTION("Celestica seastone2 platform driver");
+#else
+MODULE_DESCRIPTION("Celestica questone2 platform driver");
+#endif
+MODULE_VERSION(MOD_VERSION);
+MODULE_LICENSE("GPL");
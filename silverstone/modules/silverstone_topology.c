@@ -0,0 +1,133 @@
+/*
+ * silverstone_topology.c - Silverstone Switch board FPGA/CPLD topology.
+ *
+ * Author: Pradchaya Phucharoen
+ *
+ * Copyright (C) 2018 Celestica Corp.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *   /
+ *   \--sys
+ *       \--devices
+ *            \--platform
+ *                \--AS58128.switchboard
+ *                    |--FPGA
+ *                    |--CPLD1
+ *                    |--CPLD2
+ *                    \--SFF
+ *                        |--QSFP[1..32]
+ *                        \--SFP[1..2]
+ *
+ */
+
+#ifndef TEST_MODE
+#define MOD_VERSION "1.0.1"
+#else
+#define MOD_VERSION "TEST"
+#endif
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+
+#include "fpga_switchboard.h"
+
+#define VIRTUAL_I2C_QSFP_PORT           32
+#define VIRTUAL_I2C_SFP_PORT            2
+
+#define SFF_PORT_TOTAL    VIRTUAL_I2C_QSFP_PORT + VIRTUAL_I2C_SFP_PORT
+
+#define VIRTUAL_I2C_BUS_OFFSET  10
+
+/* PREDEFINED I2C SWITCH DEVICE TOPOLOGY */
+static const struct i2c_switch fpga_i2c_bus_dev[] = {
+    /* BUS3 QSFP Exported as virtual bus */
+    {I2C_MASTER_CH_3, 0x71, 2, QSFP, "QSFP1"}, {I2C_MASTER_CH_3, 0x71, 3, QSFP, "QSFP2"},
+    {I2C_MASTER_CH_3, 0x71, 0, QSFP, "QSFP3"}, {I2C_MASTER_CH_3, 0x71, 1, QSFP, "QSFP4"},
+    {I2C_MASTER_CH_3, 0x71, 6, QSFP, "QSFP5"}, {I2C_MASTER_CH_3, 0x71, 5, QSFP, "QSFP6"},
+    {I2C_MASTER_CH_3, 0x73, 7, QSFP, "QSFP7"}, {I2C_MASTER_CH_3, 0x71, 4, QSFP, "QSFP8"},
+
+    {I2C_MASTER_CH_3, 0x73, 4, QSFP, "QSFP9"},  {I2C_MASTER_CH_3, 0x73, 3, QSFP, "QSFP10"},
+    {I2C_MASTER_CH_3, 0x73, 6, QSFP, "QSFP11"}, {I2C_MASTER_CH_3, 0x73, 2, QSFP, "QSFP12"},
+    {I2C_MASTER_CH_3, 0x73, 1, QSFP, "QSFP13"}, {I2C_MASTER_CH_3, 0x73, 5, QSFP, "QSFP14"},
+    {I2C_MASTER_CH_3, 0x71, 7, QSFP, "QSFP15"}, {I2C_MASTER_CH_3, 0x73, 0, QSFP, "QSFP16"},
+
+    {I2C_MASTER_CH_3, 0x72, 1, QSFP, "QSFP17"}, {I2C_MASTER_CH_3, 0x72, 7, QSFP, "QSFP18"},
+    {I2C_MASTER_CH_3, 0x72, 4, QSFP, "QSFP19"}, {I2C_MASTER_CH_3, 0x72, 0, QSFP, "QSFP20"},
+    {I2C_MASTER_CH_3, 0x72, 5, QSFP, "QSFP21"}, {I2C_MASTER_CH_3, 0x72, 2, QSFP, "QSFP22"},
+    {I2C_MASTER_CH_3, 0x70, 5, QSFP, "QSFP23"}, {I2C_MASTER_CH_3, 0x72, 6, QSFP, "QSFP24"},
+
+    {I2C_MASTER_CH_3, 0x72, 3, QSFP, "QSFP25"}, {I2C_MASTER_CH_3, 0x70, 6, QSFP, "QSFP26"},
+    {I2C_MASTER_CH_3, 0x70, 0, QSFP, "QSFP27"}, {I2C_MASTER_CH_3, 0x70, 7, QSFP, "QSFP28"},
+    {I2C_MASTER_CH_3, 0x70, 2, QSFP, "QSFP29"}, {I2C_MASTER_CH_3, 0x70, 4, QSFP, "QSFP30"},
+    {I2C_MASTER_CH_3, 0x70, 3, QSFP, "QSFP31"}, {I2C_MASTER_CH_3, 0x70, 1, QSFP, "QSFP32"},
+    /* BUS1 SFP+ Exported as virtual bus */
+    {I2C_MASTER_CH_1, 0xFF, 0, SFP, "SFP1"},
+    /* BUS2 SFP+ Exported as virtual bus */
+    {I2C_MASTER_CH_2, 0xFF, 0, SFP, "SFP2"},
+    /* BUS4 CPLD Access via I2C */
+    {I2C_MASTER_CH_4, 0xFF, 0, NONE, "CPLD_S"},
+    /* BUS5 CPLD_B */
+    {I2C_MASTER_CH_5, 0xFF, 0, NONE, "CPLD_B"},
+    /* BUS6 POWER CHIP Exported as virtual bus */
+    {I2C_MASTER_CH_6, 0xFF, 0, NONE, "VR"},
+    /* BUS7 PSU */
+    {I2C_MASTER_CH_7, 0xFF, 0, NONE, "PSU"},
+    /* BUS8 FAN */
+    {I2C_MASTER_CH_8, 0xFF, 0, NONE, "CPLD_fan"},
+    /* Note: Channel 2 has no hardware connected */
+    {I2C_MASTER_CH_8, 0x77, 4, NONE, "FAN1"}, {I2C_MASTER_CH_8, 0x77, 5, NONE, "FAN2"},
+    {I2C_MASTER_CH_8, 0x77, 6, NONE, "FAN3"}, {I2C_MASTER_CH_8, 0x77, 3, NONE, "FAN4"},
+    {I2C_MASTER_CH_8, 0x77, 0, NONE, "FAN5"}, {I2C_MASTER_CH_8, 0x77, 1, NONE, "FAN6"}, {I2C_MASTER_CH_8, 0x77, 2, NONE, "FAN7"},
+    /* BUS9 POWER MONITOR */
+    {I2C_MASTER_CH_9,  0xFF, 0, NONE, "UCD90120"},
+    /* BUS10 LM75 */
+    {I2C_MASTER_CH_10, 0xFF, 0, NONE, "LM75"},
+    /* BUS11 SI5344D */
+    {I2C_MASTER_CH_11, 0xFF, 0, NONE, "SI5344D"},
+    /* BUS12 PCIe Buffer */
+    {I2C_MASTER_CH_12, 0xFF, 0, NONE, "PCIe Buffer"},
+    /* BUS13 MAX6696 */
+    {I2C_MASTER_CH_13, 0xFF, 0, NONE, "MAX6696"},
+};
+
+/* CPLD_LED_COLOR encoding, 3 bits */
+static const char *const silverstone_led_colors[] = {
+    "white", "magenta", "cyan", "blue", "yellow", "red", "green", "off",
+};
+
+static const struct fpga_switchboard_topology silverstone_topology = {
+    .driver_name = "AS58128.switchboard",
+    .class_name = "silverstone_fpga",
+    .pci_name = "Silverstone_fpga_pci",
+    .i2c_masters = I2C_MASTER_CH_13,
+    .bus_offset = VIRTUAL_I2C_BUS_OFFSET,
+    .buses = fpga_i2c_bus_dev,
+    .n_buses = ARRAY_SIZE(fpga_i2c_bus_dev),
+    .sff_ports = SFF_PORT_TOTAL,
+    .cpld_bus = SFF_PORT_TOTAL,
+    .led_colors = silverstone_led_colors,
+    .n_led_colors = ARRAY_SIZE(silverstone_led_colors),
+};
+
+static int __init silverstone_init(void)
+{
+    return fpga_switchboard_init(&silverstone_topology);
+}
+
+static void __exit silverstone_exit(void)
+{
+    fpga_switchboard_exit();
+}
+
+module_init(silverstone_init);
+module_exit(silverstone_exit);
+
+MODULE_AUTHOR("Celestica Inc.");
+MODULE_DESCRIPTION("Celestica Silverstone platform driver");
+MODULE_VERSION(MOD_VERSION);
+MODULE_LICENSE("GPL");